@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "3dsystem/3d_arena.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_EXTENDED_LIMITS
+// Initial sizes are the former fixed buffer sizes
+#define SORT_INIT_COUNT		(16000)
+// The sort key keeps the poly index in its low 16 bits
+#define SORT_MAX_COUNT		(0x10000)
+#define INFO3D_INIT_COUNT	(480000)
+#define INFO3D_MAX_COUNT	(0x1000000)
+#define VERTEX_INIT_COUNT	(0x8000)
+#define VERTEX_MAX_COUNT	(0x100000)
+
+SORT_ITEM *SortBuffer = NULL;
+__int16 *Info3dBuffer = NULL;
+D3DTLVERTEX *HWR_VertexBuffer = NULL;
+
+static FRAME_ARENA SortArena;
+static FRAME_ARENA SortScratchArena;
+static FRAME_ARENA Info3dArena;
+static FRAME_ARENA VertexArena;
+
+/*
+ * The arena reserves address space for the maximum size, and commits
+ * memory for the actual size only. The commit grows geometrically, and
+ * the base address never moves, so the pointers to the arena items
+ * (such as SortBuffer to Info3dBuffer links) stay valid while growing.
+ */
+bool FrameArenaCreate(FRAME_ARENA *arena, LPCTSTR name, DWORD itemSize, DWORD initCount, DWORD maxCount) {
+	memset(arena, 0, sizeof(FRAME_ARENA));
+	arena->name = name;
+	arena->itemSize = itemSize;
+	arena->base = (BYTE *)VirtualAlloc(NULL, itemSize * maxCount, MEM_RESERVE, PAGE_READWRITE);
+	if( arena->base == NULL ) return false;
+	arena->reserved = maxCount;
+	return FrameArenaReserve(arena, initCount);
+}
+
+void FrameArenaDestroy(FRAME_ARENA *arena) {
+	if( arena->base != NULL ) {
+		VirtualFree(arena->base, 0, MEM_RELEASE);
+	}
+	memset(arena, 0, sizeof(FRAME_ARENA));
+}
+
+bool FrameArenaReserve(FRAME_ARENA *arena, DWORD count) {
+	if( count <= arena->committed ) return true;
+	if( count > arena->reserved ) return false;
+
+	DWORD newCount = arena->committed * 2;
+	CLAMPL(newCount, count);
+	CLAMPG(newCount, arena->reserved);
+	if( NULL == VirtualAlloc(arena->base, arena->itemSize * newCount, MEM_COMMIT, PAGE_READWRITE) ) {
+		return false;
+	}
+	arena->committed = newCount;
+	return true;
+}
+
+static void FrameArenaUsed(FRAME_ARENA *arena, DWORD count) {
+	CLAMPL(arena->highWater, count);
+}
+
+bool ARENA_Init() {
+	if( !FrameArenaCreate(&SortArena, "SortBuffer", sizeof(SORT_ITEM), SORT_INIT_COUNT, SORT_MAX_COUNT)
+		|| !FrameArenaCreate(&SortScratchArena, "SortScratch", sizeof(SORT_ITEM), SORT_INIT_COUNT, SORT_MAX_COUNT)
+		|| !FrameArenaCreate(&Info3dArena, "Info3dBuffer", sizeof(__int16), INFO3D_INIT_COUNT, INFO3D_MAX_COUNT)
+		|| !FrameArenaCreate(&VertexArena, "HWR_VertexBuffer", sizeof(D3DTLVERTEX), VERTEX_INIT_COUNT, VERTEX_MAX_COUNT) )
+	{
+		ARENA_Cleanup();
+		return false;
+	}
+	SortBuffer = (SORT_ITEM *)SortArena.base;
+	Info3dBuffer = (__int16 *)Info3dArena.base;
+	HWR_VertexBuffer = (D3DTLVERTEX *)VertexArena.base;
+	return true;
+}
+
+void ARENA_Cleanup() {
+	FrameArenaDestroy(&SortArena);
+	FrameArenaDestroy(&SortScratchArena);
+	FrameArenaDestroy(&Info3dArena);
+	FrameArenaDestroy(&VertexArena);
+	SortBuffer = NULL;
+	Info3dBuffer = NULL;
+	HWR_VertexBuffer = NULL;
+}
+
+// Records the usage of the previous frame before the poly list reset
+void ARENA_FrameDone() {
+	if( SortBuffer == NULL ) return;
+	FrameArenaUsed(&SortArena, Sort3dPtr - SortBuffer);
+	FrameArenaUsed(&Info3dArena, Info3dPtr - Info3dBuffer);
+	if( SavedAppSettings.RenderMode == RM_Hardware ) {
+		FrameArenaUsed(&VertexArena, HWR_VertexPtr - HWR_VertexBuffer);
+	}
+}
+
+// Writes the high-water marks of the finished level into the log
+void ARENA_Report() {
+	FRAME_ARENA *arenas[] = {&SortArena, &Info3dArena, &VertexArena};
+
+	for( DWORD i = 0; i < ARRAY_SIZE(arenas); ++i ) {
+		if( arenas[i]->highWater == 0 ) continue;
+		printf("FrameArena: %s high-water=%lu committed=%lu\n",
+			arenas[i]->name, arenas[i]->highWater, arenas[i]->committed);
+		arenas[i]->highWater = 0;
+	}
+	fflush(stdout);
+}
+
+bool PolyListReserve(DWORD polys, DWORD info3d) {
+	return FrameArenaReserve(&SortArena, (Sort3dPtr - SortBuffer) + polys)
+		&& FrameArenaReserve(&Info3dArena, (Info3dPtr - Info3dBuffer) + info3d);
+}
+
+bool VertexListReserve(DWORD vertices) {
+	return FrameArenaReserve(&VertexArena, vertices);
+}
+
+SORT_ITEM *GetSortScratch(DWORD count) {
+	if( !FrameArenaReserve(&SortScratchArena, count) ) return NULL;
+	return (SORT_ITEM *)SortScratchArena.base;
+}
+#endif // FEATURE_EXTENDED_LIMITS
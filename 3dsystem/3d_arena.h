@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _3DARENA_H_INCLUDED
+#define _3DARENA_H_INCLUDED
+
+#include "global/types.h"
+
+#ifdef FEATURE_EXTENDED_LIMITS
+// Returns from the insert function if there is no room for one more poly
+#define POLYLIST_RESERVE	{if( !PolyListReserve(1, POLY_INFO_MAX) ) return;}
+#else // FEATURE_EXTENDED_LIMITS
+#define POLYLIST_RESERVE
+#endif // FEATURE_EXTENDED_LIMITS
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_EXTENDED_LIMITS
+bool FrameArenaCreate(FRAME_ARENA *arena, LPCTSTR name, DWORD itemSize, DWORD initCount, DWORD maxCount);
+void FrameArenaDestroy(FRAME_ARENA *arena);
+bool FrameArenaReserve(FRAME_ARENA *arena, DWORD count);
+
+bool ARENA_Init();
+void ARENA_Cleanup();
+void ARENA_FrameDone();
+void ARENA_Report();
+bool PolyListReserve(DWORD polys, DWORD info3d);
+bool VertexListReserve(DWORD vertices);
+SORT_ITEM *GetSortScratch(DWORD count);
+#endif // FEATURE_EXTENDED_LIMITS
+
+#endif // _3DARENA_H_INCLUDED
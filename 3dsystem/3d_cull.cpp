@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "3dsystem/3d_cull.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_RENDER_IMPROVED
+// Faces closer to the edge-on state than this distance are never culled
+#define CULL_MARGIN		(8.0)
+// Room clusters are square cells of this number of sectors (grown for huge rooms)
+#define CULL_CLUSTER_SECTORS	(4)
+#define CULL_CLUSTERS_MAX		(256)
+
+typedef struct MeshLayout_t {
+	__int16 *vertices;
+	int vtxCount;
+	int vtxStride;
+	__int16 *faces;
+	int nLists;
+} MESH_LAYOUT;
+
+// Object meshes have GT4, GT3, G4, G3 face lists, rooms have GT4, GT3 only
+static const int FaceListVertices[4] = {4, 3, 4, 3};
+
+static CULL_MESH *CullMeshes = NULL;
+static DWORD CullMeshCount = 0;
+static FACE_PLANE *CullPlanes = NULL;
+static CULL_CLUSTER *CullClusters = NULL;
+static __int16 *CullFaces = NULL;
+static BYTE CullVtxMask[ARRAY_SIZE(PhdVBuf)];
+
+static void GetMeshLayout(__int16 *ptrObj, bool isRoom, MESH_LAYOUT *layout) {
+	int num;
+
+	if( isRoom ) {
+		layout->vtxCount = *ptrObj++;
+		layout->vtxStride = 6;
+		layout->vertices = ptrObj;
+		ptrObj += layout->vtxCount * 6;
+		layout->nLists = 2;
+	} else {
+		ptrObj += 5; // skip x, y, z, radius, flags
+		layout->vtxCount = *ptrObj++;
+		layout->vtxStride = 3;
+		layout->vertices = ptrObj;
+		ptrObj += layout->vtxCount * 3;
+		num = *ptrObj++; // skip normals or vertex lights
+		ptrObj += ( num > 0 ) ? num * 3 : -num;
+		layout->nLists = 4;
+	}
+	layout->faces = ptrObj;
+}
+
+// Returns the face section size in words, and fills the face planes if required
+static int GetMeshPlanes(__int16 *ptrObj, bool isRoom, FACE_PLANE *planes) {
+	MESH_LAYOUT layout;
+	__int16 *ptr, *v0, *v1, *v2;
+	double ax, ay, az, bx, by, bz, nx, ny, nz, len;
+	int i, j, num;
+
+	GetMeshLayout(ptrObj, isRoom, &layout);
+	ptr = layout.faces;
+	for( i = 0; i < layout.nLists; ++i ) {
+		num = *ptr++;
+		for( j = 0; j < num; ++j ) {
+			if( planes != NULL ) {
+				v0 = &layout.vertices[ptr[0] * layout.vtxStride];
+				v1 = &layout.vertices[ptr[1] * layout.vtxStride];
+				v2 = &layout.vertices[ptr[2] * layout.vtxStride];
+				// the same vertices are used for the screen space visibility check
+				ax = v1[0] - v0[0]; ay = v1[1] - v0[1]; az = v1[2] - v0[2];
+				bx = v2[0] - v0[0]; by = v2[1] - v0[1]; bz = v2[2] - v0[2];
+				nx = by * az - bz * ay;
+				ny = bz * ax - bx * az;
+				nz = bx * ay - by * ax;
+				len = sqrt(nx * nx + ny * ny + nz * nz);
+				if( len > 0.0 ) {
+					planes->x = nx / len;
+					planes->y = ny / len;
+					planes->z = nz / len;
+					planes->d = (nx * v0[0] + ny * v0[1] + nz * v0[2]) / len;
+				} else {
+					// degenerate face is always visible
+					planes->x = planes->y = planes->z = 0.0;
+					planes->d = -CULL_MARGIN;
+				}
+				++planes;
+			}
+			ptr += FaceListVertices[i] + 1;
+		}
+	}
+	if( isRoom ) {
+		num = *ptr++; // room sprites
+		ptr += num * 2;
+	}
+	return ptr - layout.faces;
+}
+
+static int GetMeshFaceCount(__int16 *ptrObj, bool isRoom) {
+	MESH_LAYOUT layout;
+	__int16 *ptr;
+	int i, num, faceCount = 0;
+
+	GetMeshLayout(ptrObj, isRoom, &layout);
+	ptr = layout.faces;
+	for( i = 0; i < layout.nLists; ++i ) {
+		num = *ptr++;
+		faceCount += num;
+		ptr += num * (FaceListVertices[i] + 1);
+	}
+	return faceCount;
+}
+
+// Returns the cluster cell size, or zero if the room is too small to be split
+static int GetClusterCellSize(ROOM_INFO *room, int *gx, int *gz) {
+	int sectors = CULL_CLUSTER_SECTORS;
+
+	for( ;; ) {
+		// xSize is the number of sectors along Z, ySize along X
+		*gx = (room->ySize + sectors - 1) / sectors;
+		*gz = (room->xSize + sectors - 1) / sectors;
+		if( *gx * *gz <= CULL_CLUSTERS_MAX ) break;
+		sectors *= 2;
+	}
+	return ( *gx * *gz > 1 ) ? sectors << WALL_SHIFT : 0;
+}
+
+static int __cdecl CompareCullMeshes(const void *a, const void *b) {
+	DWORD ptrA = (DWORD)((CULL_MESH *)a)->mesh;
+	DWORD ptrB = (DWORD)((CULL_MESH *)b)->mesh;
+	return ( ptrA > ptrB ) - ( ptrA < ptrB );
+}
+
+static CULL_MESH *FindCullMesh(__int16 *ptrObj) {
+	int left = 0;
+	int right = (int)CullMeshCount - 1;
+
+	while( left <= right ) {
+		int mid = (left + right) / 2;
+		if( CullMeshes[mid].mesh == ptrObj ) {
+			return &CullMeshes[mid];
+		} else if( CullMeshes[mid].mesh < ptrObj ) {
+			left = mid + 1;
+		} else {
+			right = mid - 1;
+		}
+	}
+	return NULL;
+}
+
+// Gets the view origin in the mesh space by inverting the current matrix
+static bool GetViewOrigin(double *x, double *y, double *z) {
+	PHD_MATRIX *m = PhdMatrixPtr;
+	double c00, c01, c02, c10, c11, c12, c20, c21, c22, det;
+
+	c00 = (double)m->_11 * m->_22 - (double)m->_12 * m->_21;
+	c01 = (double)m->_12 * m->_20 - (double)m->_10 * m->_22;
+	c02 = (double)m->_10 * m->_21 - (double)m->_11 * m->_20;
+	c10 = (double)m->_02 * m->_21 - (double)m->_01 * m->_22;
+	c11 = (double)m->_00 * m->_22 - (double)m->_02 * m->_20;
+	c12 = (double)m->_01 * m->_20 - (double)m->_00 * m->_21;
+	c20 = (double)m->_01 * m->_12 - (double)m->_02 * m->_11;
+	c21 = (double)m->_02 * m->_10 - (double)m->_00 * m->_12;
+	c22 = (double)m->_00 * m->_11 - (double)m->_01 * m->_10;
+	det = m->_00 * c00 + m->_01 * c01 + m->_02 * c02;
+
+	// mirrored or degenerate matrix flips the visibility, so don't cull
+	if( det <= 0.0 ) return false;
+
+	*x = -(c00 * m->_03 + c10 * m->_13 + c20 * m->_23) / det;
+	*y = -(c01 * m->_03 + c11 * m->_13 + c21 * m->_23) / det;
+	*z = -(c02 * m->_03 + c12 * m->_13 + c22 * m->_23) / det;
+	return true;
+}
+
+// Splits the room faces into the grid cells by the face centers
+static int BuildRoomClusters(ROOM_INFO *room, CULL_MESH *cullMesh, CULL_CLUSTER *clusters, BYTE *faceClusters) {
+	MESH_LAYOUT layout;
+	CULL_CLUSTER *cluster;
+	__int16 *ptr, *vtx;
+	int i, j, k, num, nVtx, cx, cz, gx, gz, cellSize;
+
+	cellSize = GetClusterCellSize(room, &gx, &gz);
+	if( cellSize == 0 ) return 0;
+
+	for( i = 0; i < gx * gz; ++i ) {
+		clusters[i].minX = clusters[i].minY = clusters[i].minZ = 0x7FFF;
+		clusters[i].maxX = clusters[i].maxY = clusters[i].maxZ = -0x7FFF;
+	}
+	GetMeshLayout(room->data, true, &layout);
+	ptr = layout.faces;
+	for( i = 0; i < layout.nLists; ++i ) {
+		num = *ptr++;
+		nVtx = FaceListVertices[i];
+		for( j = 0; j < num; ++j ) {
+			cx = cz = 0;
+			for( k = 0; k < nVtx; ++k ) {
+				vtx = &layout.vertices[ptr[k] * layout.vtxStride];
+				cx += vtx[0];
+				cz += vtx[2];
+			}
+			cx = cx / nVtx / cellSize;
+			cz = cz / nVtx / cellSize;
+			CLAMP(cx, 0, gx - 1);
+			CLAMP(cz, 0, gz - 1);
+			*faceClusters++ = cz * gx + cx;
+			cluster = &clusters[cz * gx + cx];
+			for( k = 0; k < nVtx; ++k ) {
+				vtx = &layout.vertices[ptr[k] * layout.vtxStride];
+				CLAMPG(cluster->minX, vtx[0]);
+				CLAMPG(cluster->minY, vtx[1]);
+				CLAMPG(cluster->minZ, vtx[2]);
+				CLAMPL(cluster->maxX, vtx[0]);
+				CLAMPL(cluster->maxY, vtx[1]);
+				CLAMPL(cluster->maxZ, vtx[2]);
+			}
+			ptr += nVtx + 1;
+		}
+	}
+	cullMesh->clusters = clusters;
+	cullMesh->nClusters = gx * gz;
+	return gx * gz;
+}
+
+// Checks the cluster bounds against the near/far planes and the room screen rectangle
+static bool IsClusterVisible(CULL_CLUSTER *cluster, BOOL isOutside) {
+	PHD_MATRIX *m = PhdMatrixPtr;
+	double xv, yv, zv, persp, margin;
+	double xMin, yMin, xMax, yMax;
+	int i, x, y, z, zMin, zMax, nearCount;
+
+	if( cluster->minX > cluster->maxX ) return false; // empty cluster
+
+	margin = IsWibbleEffect ? (double)(MAX_WIBBLE + 1) : 1.0;
+	xMin = yMin = 1.0e10;
+	xMax = yMax = -1.0e10;
+	zMin = 0x7FFFFFFF;
+	zMax = -0x7FFFFFFF;
+	nearCount = 0;
+
+	for( i = 0; i < 8; ++i ) {
+		x = ( i & 1 ) ? cluster->maxX : cluster->minX;
+		y = ( i & 2 ) ? cluster->maxY : cluster->minY;
+		z = ( i & 4 ) ? cluster->maxZ : cluster->minZ;
+		xv = (double)(m->_00 * x + m->_01 * y + m->_02 * z + m->_03);
+		yv = (double)(m->_10 * x + m->_11 * y + m->_12 * z + m->_13);
+		zv = (double)(m->_20 * x + m->_21 * y + m->_22 * z + m->_23);
+		CLAMPG(zMin, (int)zv);
+		CLAMPL(zMax, (int)zv);
+		if( zv < FltNearZ ) {
+			++nearCount;
+			continue;
+		}
+		persp = FltPersp / zv;
+		xv = persp * xv + FltWinCenterX;
+		yv = persp * yv + FltWinCenterY;
+		CLAMPG(xMin, xv);
+		CLAMPG(yMin, yv);
+		CLAMPL(xMax, xv);
+		CLAMPL(yMax, yv);
+	}
+
+	// all vertices are clipped by the near plane
+	if( nearCount == 8 ) return false;
+	// all vertices are clipped by the far plane (outside rooms are drawn with fog instead)
+#ifdef FEATURE_VIEW_IMPROVED
+	if( !isOutside && (zMin >> W2V_SHIFT) >= PhdViewDistance ) return false;
+#else // !FEATURE_VIEW_IMPROVED
+	if( !isOutside && (zMin >> W2V_SHIFT) >= DEPTHQ_END ) return false;
+#endif // FEATURE_VIEW_IMPROVED
+	// the screen rectangle is not reliable if some vertices are behind the near plane
+	if( nearCount > 0 ) return true;
+
+	return ( xMax + margin >= FltWinLeft && xMin - margin <= FltWinRight &&
+			 yMax + margin >= FltWinTop && yMin - margin <= FltWinBottom );
+}
+
+/*
+ * Copies the faces facing the view origin, and marks the vertices used by
+ * them. The result has the same layout as the mesh face section, so it can
+ * be passed to the insert functions as is. The skipped faces are back faces
+ * or faces of invisible room clusters, which would be rejected by the
+ * screen space checks anyway.
+ */
+static __int16 *CullFaceLists(CULL_MESH *cullMesh, bool isRoom, BYTE *clusterVisible, BYTE **vtxMask) {
+	MESH_LAYOUT layout;
+	FACE_PLANE *plane;
+	BYTE *faceCluster;
+	__int16 *src, *dst, *dstCount;
+	double x, y, z;
+	int i, j, k, num, nVtx, count;
+
+	GetMeshLayout(cullMesh->mesh, isRoom, &layout);
+	if( layout.vtxCount <= 0 || layout.vtxCount > (int)ARRAY_SIZE(CullVtxMask) ) return NULL;
+	if( !GetViewOrigin(&x, &y, &z) ) return NULL;
+
+	memset(CullVtxMask, 0, layout.vtxCount);
+	plane = cullMesh->planes;
+	faceCluster = cullMesh->faceClusters;
+	src = layout.faces;
+	dst = CullFaces;
+	for( i = 0; i < layout.nLists; ++i ) {
+		num = *src++;
+		nVtx = FaceListVertices[i];
+		dstCount = dst++;
+		count = 0;
+		for( j = 0; j < num; ++j ) {
+			if( (clusterVisible == NULL || clusterVisible[faceCluster[j]])
+				&& plane->x * x + plane->y * y + plane->z * z - plane->d > -CULL_MARGIN )
+			{
+				for( k = 0; k < nVtx; ++k ) {
+					CullVtxMask[src[k]] = 1;
+				}
+				memcpy(dst, src, sizeof(__int16) * (nVtx + 1));
+				dst += nVtx + 1;
+				++count;
+			}
+			src += nVtx + 1;
+			++plane;
+		}
+		if( faceCluster != NULL ) {
+			faceCluster += num;
+		}
+		*dstCount = count;
+	}
+	if( isRoom ) {
+		// room sprites are copied as is
+		num = *src;
+		for( j = 0; j < num; ++j ) {
+			CullVtxMask[src[1 + j * 2]] = 1;
+		}
+		memcpy(dst, src, sizeof(__int16) * (1 + num * 2));
+	}
+	*vtxMask = CullVtxMask;
+	return CullFaces;
+}
+
+void CULL_LevelInit(__int16 **meshPtr, DWORD meshCount) {
+	DWORD i, planeCount = 0, clusterCount = 0;
+	int size, maxSize = 0, gx, gz;
+	FACE_PLANE *planes;
+	CULL_CLUSTER *clusters;
+	BYTE *faceClusters;
+
+	CULL_Cleanup();
+	CullMeshes = (CULL_MESH *)malloc(sizeof(CULL_MESH) * (RoomCount + meshCount));
+	if( CullMeshes == NULL ) return;
+	memset(CullMeshes, 0, sizeof(CULL_MESH) * (RoomCount + meshCount));
+
+	// Object meshes may be shared by several pointers, so add the unique ones
+	for( i = 0; i < meshCount; ++i ) {
+		CullMeshes[i].mesh = meshPtr[i];
+	}
+	qsort(CullMeshes, meshCount, sizeof(CULL_MESH), CompareCullMeshes);
+	for( i = 0; i < meshCount; ++i ) {
+		if( CullMeshCount == 0 || CullMeshes[CullMeshCount - 1].mesh != CullMeshes[i].mesh ) {
+			CullMeshes[CullMeshCount++].mesh = CullMeshes[i].mesh;
+		}
+	}
+	// Rooms are the last ones
+	for( i = 0; i < (DWORD)RoomCount; ++i ) {
+		CullMeshes[CullMeshCount++].mesh = RoomInfo[i].data;
+		if( GetClusterCellSize(&RoomInfo[i], &gx, &gz) != 0 ) {
+			clusterCount += gx * gz;
+		}
+	}
+	for( i = 0; i < CullMeshCount; ++i ) {
+		bool isRoom = ( i >= CullMeshCount - RoomCount );
+		planeCount += GetMeshFaceCount(CullMeshes[i].mesh, isRoom);
+	}
+
+	CullPlanes = (FACE_PLANE *)malloc(sizeof(FACE_PLANE) * planeCount);
+	CullClusters = (CULL_CLUSTER *)malloc(sizeof(CULL_CLUSTER) * clusterCount + planeCount);
+	if( CullPlanes == NULL || CullClusters == NULL ) {
+		CULL_Cleanup();
+		return;
+	}
+	planes = CullPlanes;
+	clusters = CullClusters;
+	faceClusters = (BYTE *)(CullClusters + clusterCount);
+	for( i = 0; i < CullMeshCount; ++i ) {
+		bool isRoom = ( i >= CullMeshCount - RoomCount );
+		size = GetMeshPlanes(CullMeshes[i].mesh, isRoom, planes);
+		CLAMPL(maxSize, size);
+		CullMeshes[i].planes = planes;
+		planes += GetMeshFaceCount(CullMeshes[i].mesh, isRoom);
+		if( isRoom ) {
+			ROOM_INFO *room = &RoomInfo[i - (CullMeshCount - RoomCount)];
+			if( BuildRoomClusters(room, &CullMeshes[i], clusters, faceClusters) != 0 ) {
+				CullMeshes[i].faceClusters = faceClusters;
+				clusters += CullMeshes[i].nClusters;
+				faceClusters += GetMeshFaceCount(CullMeshes[i].mesh, true);
+			}
+		}
+	}
+
+	CullFaces = (__int16 *)malloc(sizeof(__int16) * maxSize);
+	if( CullFaces == NULL ) {
+		CULL_Cleanup();
+		return;
+	}
+
+	// Rooms are added after the object meshes, so sort everything once again
+	qsort(CullMeshes, CullMeshCount, sizeof(CULL_MESH), CompareCullMeshes);
+}
+
+void CULL_Cleanup() {
+	if( CullMeshes != NULL ) {
+		free(CullMeshes);
+		CullMeshes = NULL;
+	}
+	if( CullPlanes != NULL ) {
+		free(CullPlanes);
+		CullPlanes = NULL;
+	}
+	if( CullClusters != NULL ) {
+		free(CullClusters);
+		CullClusters = NULL;
+	}
+	if( CullFaces != NULL ) {
+		free(CullFaces);
+		CullFaces = NULL;
+	}
+	CullMeshCount = 0;
+}
+
+/*
+ * Moves the tables of the previous load of the same level to the new level
+ * image address, so they are not calculated again. Returns false if there
+ * are no tables or some mesh was not inside the previous image.
+ */
+bool CULL_LevelRebase(BYTE *oldBase, DWORD oldSize, BYTE *newBase) {
+	DWORD i;
+
+	if( CullFaces == NULL || oldBase == NULL || newBase == NULL ) return false;
+	for( i = 0; i < CullMeshCount; ++i ) {
+		BYTE *mesh = (BYTE *)CullMeshes[i].mesh;
+		if( mesh < oldBase || mesh >= oldBase + oldSize ) return false;
+	}
+	// The offset is the same for all meshes, so the sort order is kept
+	for( i = 0; i < CullMeshCount; ++i ) {
+		CullMeshes[i].mesh = (__int16 *)(newBase + ((BYTE *)CullMeshes[i].mesh - oldBase));
+	}
+	return true;
+}
+
+__int16 *CULL_MeshFaces(__int16 *ptrObj, BYTE **vtxMask) {
+	CULL_MESH *cullMesh;
+
+	if( CullFaces == NULL ) return NULL;
+	cullMesh = FindCullMesh(ptrObj);
+	if( cullMesh == NULL ) return NULL;
+	return CullFaceLists(cullMesh, false, NULL, vtxMask);
+}
+
+__int16 *CULL_RoomFaces(__int16 *ptrObj, BOOL isOutside, BYTE **vtxMask) {
+	CULL_MESH *cullMesh;
+	BYTE clusterVisible[CULL_CLUSTERS_MAX];
+
+	if( CullFaces == NULL ) return NULL;
+	cullMesh = FindCullMesh(ptrObj);
+	if( cullMesh == NULL ) return NULL;
+	if( cullMesh->nClusters == 0 ) {
+		return CullFaceLists(cullMesh, true, NULL, vtxMask);
+	}
+	for( int i = 0; i < cullMesh->nClusters; ++i ) {
+		clusterVisible[i] = IsClusterVisible(&cullMesh->clusters[i], isOutside);
+	}
+	return CullFaceLists(cullMesh, true, clusterVisible, vtxMask);
+}
+#endif // FEATURE_RENDER_IMPROVED
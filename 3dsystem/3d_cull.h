@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _3DCULL_H_INCLUDED
+#define _3DCULL_H_INCLUDED
+
+#include "global/types.h"
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_RENDER_IMPROVED
+void CULL_LevelInit(__int16 **meshPtr, DWORD meshCount);
+void CULL_Cleanup();
+bool CULL_LevelRebase(BYTE *oldBase, DWORD oldSize, BYTE *newBase);
+__int16 *CULL_MeshFaces(__int16 *ptrObj, BYTE **vtxMask);
+__int16 *CULL_RoomFaces(__int16 *ptrObj, BOOL isOutside, BYTE **vtxMask);
+#endif // FEATURE_RENDER_IMPROVED
+
+#endif // _3DCULL_H_INCLUDED
@@ -21,10 +21,17 @@
 
 #include "global/precompiled.h"
 #include "3dsystem/3d_gen.h"
+#include "3dsystem/3d_arena.h"
+#include "3dsystem/3d_cull.h"
 #include "3dsystem/3d_out.h"
 #include "3dsystem/3dinsert.h"
 #include "3dsystem/phd_math.h"
 #include "3dsystem/scalespr.h"
+#ifdef FEATURE_SIMD_RENDER
+#include "3dsystem/3d_simd.h"
+#endif // FEATURE_SIMD_RENDER
+#include "3dsystem/3d_tiles.h"
+#include "modding/benchmark.h"
 #include "specific/hwr.h"
 #include "global/vars.h"
 
@@ -41,16 +48,54 @@ static void (__cdecl *PolyDrawRoutines[])(__int16 *) = {
 	draw_scaled_spriteC		// scaled sprite (texture + colorkey)
 };
 
-#if defined(FEATURE_EXTENDED_LIMITS) || defined(FEATURE_VIEW_IMPROVED)
+#if !defined(FEATURE_EXTENDED_LIMITS) && defined(FEATURE_VIEW_IMPROVED)
 SORT_ITEM SortBuffer[16000];
 __int16 Info3dBuffer[480000];
-#endif // defined(FEATURE_EXTENDED_LIMITS) || defined(FEATURE_VIEW_IMPROVED)
+#endif // !defined(FEATURE_EXTENDED_LIMITS) && defined(FEATURE_VIEW_IMPROVED)
 
 #ifdef FEATURE_EXTENDED_LIMITS
 PHD_SPRITE PhdSpriteInfo[2048];
-D3DTLVERTEX HWR_VertexBuffer[0x8000];
 #endif // FEATURE_EXTENDED_LIMITS
 
+#ifdef FEATURE_SIMD_RENDER
+static VTX_STAGE VtxStage __attribute__((aligned(32)));
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_RENDER_IMPROVED
+// If set, only the marked vertices are transformed and projected
+static BYTE *VtxCullMask = NULL;
+#endif // FEATURE_RENDER_IMPROVED
+
+#ifdef FEATURE_SIMD_RENDER
+#ifdef FEATURE_RENDER_IMPROVED
+static __int16 VtxGather[VTX_STAGE_SIZE * 3];
+static int VtxGatherIdx[VTX_STAGE_SIZE];
+#endif // FEATURE_RENDER_IMPROVED
+
+// Transforms the next batch of vertices. If there is the cull mask,
+// the marked vertices are gathered and only they are transformed
+static void TransformBatch(__int16 *ptrObj, int vtxIdx, int vtxCount, int stride) {
+#ifdef FEATURE_RENDER_IMPROVED
+	if( VtxCullMask != NULL ) {
+		int count = 0;
+		CLAMPG(vtxCount, VTX_STAGE_SIZE);
+		for( int i = 0; i < vtxCount; ++i, ptrObj += stride ) {
+			if( !VtxCullMask[vtxIdx + i] ) continue;
+			VtxGather[count * 3 + 0] = ptrObj[0];
+			VtxGather[count * 3 + 1] = ptrObj[1];
+			VtxGather[count * 3 + 2] = ptrObj[2];
+			VtxGatherIdx[i] = count++;
+		}
+		if( count > 0 ) {
+			VtxTransform(VtxGather, count, 3, &VtxStage);
+		}
+		return;
+	}
+#endif // FEATURE_RENDER_IMPROVED
+	VtxTransform(ptrObj, vtxCount, stride, &VtxStage);
+}
+#endif // FEATURE_SIMD_RENDER
+
 #ifdef FEATURE_VIEW_IMPROVED
 bool PsxFovEnabled;
 
@@ -558,15 +603,37 @@ void __cdecl phd_PutPolygons(__int16 *ptrObj, int clip) {
 #ifdef FEATURE_VIDEOFX_IMPROVED
 	__int16 *ptrEnv = ptrObj;
 #endif // FEATURE_VIDEOFX_IMPROVED
+#ifdef FEATURE_RENDER_IMPROVED
+	__int16 *ptrFaces = NULL;
+#endif // FEATURE_RENDER_IMPROVED
 
+	BENCH_START(BENCH_Transform);
+#ifdef FEATURE_RENDER_IMPROVED
+#ifdef FEATURE_VIDEOFX_IMPROVED
+	// reflection polys are enumerated over the whole mesh, so it needs all vertices
+	if( !IsReflect )
+#endif // FEATURE_VIDEOFX_IMPROVED
+	ptrFaces = CULL_MeshFaces(ptrObj, &VtxCullMask);
+#endif // FEATURE_RENDER_IMPROVED
 	ptrObj += 4; // skip x, y, z, radius
 	ptrObj = calc_object_vertices(ptrObj);
+#ifdef FEATURE_RENDER_IMPROVED
+	VtxCullMask = NULL;
+#endif // FEATURE_RENDER_IMPROVED
+	BENCH_STOP(BENCH_Transform);
 	if( ptrObj != NULL ) {
 		ptrObj = calc_vertice_light(ptrObj);
+#ifdef FEATURE_RENDER_IMPROVED
+		if( ptrFaces != NULL ) {
+			ptrObj = ptrFaces; // only the front faces are inserted
+		}
+#endif // FEATURE_RENDER_IMPROVED
+		BENCH_START(BENCH_Insert);
 		ptrObj = ins_objectGT4(ptrObj+1, *ptrObj, ST_AvgZ);
 		ptrObj = ins_objectGT3(ptrObj+1, *ptrObj, ST_AvgZ);
 		ptrObj = ins_objectG4(ptrObj+1, *ptrObj, ST_AvgZ);
 		ptrObj = ins_objectG3(ptrObj+1, *ptrObj, ST_AvgZ);
+		BENCH_STOP(BENCH_Insert);
 #ifdef FEATURE_VIDEOFX_IMPROVED
 		phd_PutEnvmapPolygons(ptrEnv);
 #endif // FEATURE_VIDEOFX_IMPROVED
@@ -581,10 +648,27 @@ void __cdecl S_InsertRoom(__int16 *ptrObj, BOOL isOutside) {
 	FltWinCenterX = (float)(PhdWinMinX + PhdWinCenterX);
 	FltWinCenterY = (float)(PhdWinMinY + PhdWinCenterY);
 
+#ifdef FEATURE_RENDER_IMPROVED
+	__int16 *ptrFaces;
+#endif // FEATURE_RENDER_IMPROVED
+
+	BENCH_START(BENCH_Transform);
+#ifdef FEATURE_RENDER_IMPROVED
+	ptrFaces = CULL_RoomFaces(ptrObj, isOutside, &VtxCullMask);
+#endif // FEATURE_RENDER_IMPROVED
 	ptrObj = calc_roomvert(ptrObj, isOutside?0x00:0x10);
+#ifdef FEATURE_RENDER_IMPROVED
+	VtxCullMask = NULL;
+	if( ptrFaces != NULL ) {
+		ptrObj = ptrFaces; // only the front faces are inserted
+	}
+#endif // FEATURE_RENDER_IMPROVED
+	BENCH_STOP(BENCH_Transform);
+	BENCH_START(BENCH_Insert);
 	ptrObj = ins_objectGT4(ptrObj+1, *ptrObj, ST_MaxZ);
 	ptrObj = ins_objectGT3(ptrObj+1, *ptrObj, ST_MaxZ);
 	ptrObj = ins_room_sprite(ptrObj+1, *ptrObj);
+	BENCH_STOP(BENCH_Insert);
 }
 
 __int16 *__cdecl calc_background_light(__int16 *ptrObj) {
@@ -672,6 +756,29 @@ __int16 *__cdecl calc_object_vertices(__int16 *ptrObj) {
 	}
 
 	for( int i = 0; i < vtxCount; ++i ) {
+#ifdef FEATURE_SIMD_RENDER
+		// transform the next batch of vertices at once, then project them one by one
+		int stageIdx = i % VTX_STAGE_SIZE;
+		if( stageIdx == 0 ) {
+			TransformBatch(ptrObj, i, vtxCount - i, 3);
+		}
+#endif // FEATURE_SIMD_RENDER
+#ifdef FEATURE_RENDER_IMPROVED
+		if( VtxCullMask != NULL && !VtxCullMask[i] ) {
+			ptrObj += 3; // the vertex is used by back faces only
+			continue;
+		}
+#endif // FEATURE_RENDER_IMPROVED
+#ifdef FEATURE_SIMD_RENDER
+#ifdef FEATURE_RENDER_IMPROVED
+		if( VtxCullMask != NULL ) {
+			stageIdx = VtxGatherIdx[stageIdx];
+		}
+#endif // FEATURE_RENDER_IMPROVED
+		xv = (double)VtxStage.xv[stageIdx];
+		yv = (double)VtxStage.yv[stageIdx];
+		zv = (double)VtxStage.zv[stageIdx];
+#else // FEATURE_SIMD_RENDER
 		xv = (double)(PhdMatrixPtr->_00 * ptrObj[0] +
 					  PhdMatrixPtr->_01 * ptrObj[1] +
 					  PhdMatrixPtr->_02 * ptrObj[2] +
@@ -686,6 +793,7 @@ __int16 *__cdecl calc_object_vertices(__int16 *ptrObj) {
 					  PhdMatrixPtr->_21 * ptrObj[1] +
 					  PhdMatrixPtr->_22 * ptrObj[2] +
 					  PhdMatrixPtr->_23);
+#endif // FEATURE_SIMD_RENDER
 
 		PhdVBuf[i].xv = xv;
 		PhdVBuf[i].yv = yv;
@@ -783,6 +891,29 @@ __int16 *__cdecl calc_roomvert(__int16 *ptrObj, BYTE farClip) {
 	vtxCount = *(ptrObj++);
 
 	for( int i = 0; i < vtxCount; ++i ) {
+#ifdef FEATURE_SIMD_RENDER
+		// transform the next batch of vertices at once, then project them one by one
+		int stageIdx = i % VTX_STAGE_SIZE;
+		if( stageIdx == 0 ) {
+			TransformBatch(ptrObj, i, vtxCount - i, 6);
+		}
+#endif // FEATURE_SIMD_RENDER
+#ifdef FEATURE_RENDER_IMPROVED
+		if( VtxCullMask != NULL && !VtxCullMask[i] ) {
+			ptrObj += 6; // the vertex is used by back faces only
+			continue;
+		}
+#endif // FEATURE_RENDER_IMPROVED
+#ifdef FEATURE_SIMD_RENDER
+#ifdef FEATURE_RENDER_IMPROVED
+		if( VtxCullMask != NULL ) {
+			stageIdx = VtxGatherIdx[stageIdx];
+		}
+#endif // FEATURE_RENDER_IMPROVED
+		xv = (double)VtxStage.xv[stageIdx];
+		yv = (double)VtxStage.yv[stageIdx];
+		zv_int = VtxStage.zv[stageIdx];
+#else // FEATURE_SIMD_RENDER
 		xv = (double)(PhdMatrixPtr->_00 * ptrObj[0] +
 					  PhdMatrixPtr->_01 * ptrObj[1] +
 					  PhdMatrixPtr->_02 * ptrObj[2] +
@@ -797,6 +928,7 @@ __int16 *__cdecl calc_roomvert(__int16 *ptrObj, BYTE farClip) {
 					  PhdMatrixPtr->_21 * ptrObj[1] +
 					  PhdMatrixPtr->_22 * ptrObj[2] +
 					  PhdMatrixPtr->_23);
+#endif // FEATURE_SIMD_RENDER
 
 		zv = (double)zv_int;
 		PhdVBuf[i].xv = xv;
@@ -886,6 +1018,9 @@ void __cdecl phd_RotateLight(__int16 pitch, __int16 yaw) {
 }
 
 void __cdecl phd_InitPolyList() {
+#ifdef FEATURE_EXTENDED_LIMITS
+	ARENA_FrameDone();
+#endif // FEATURE_EXTENDED_LIMITS
 	SurfaceCount = 0;
 	Sort3dPtr = SortBuffer;
 	Info3dPtr = Info3dBuffer;
@@ -893,7 +1028,88 @@ void __cdecl phd_InitPolyList() {
 		HWR_VertexPtr = HWR_VertexBuffer;
 }
 
+// The sort keys are unique only if the depth is shifted (see phd_SortPolyList).
+// Else the stable sorts below may order equal keys not as do_quickysorty() does,
+// so the original sort is kept in that case.
+#if defined(FEATURE_RENDER_IMPROVED) && defined(FEATURE_VIEW_IMPROVED)
+// Polys count below which the insertion sort is faster than radix passes
+#define SORT_INSERTION_LIMIT (32)
+
+#ifndef FEATURE_EXTENDED_LIMITS
+static SORT_ITEM SortScratch[ARRAY_SIZE(SortBuffer)];
+#endif // FEATURE_EXTENDED_LIMITS
+
+static void SortInsertion(SORT_ITEM *items, DWORD count) {
+	for( DWORD i = 1; i < count; ++i ) {
+		SORT_ITEM item = items[i];
+		DWORD j = i;
+		for( ; j > 0 && items[j-1]._1 < item._1; --j ) {
+			items[j] = items[j-1];
+		}
+		items[j] = item;
+	}
+}
+
+// LSD radix sort of the packed keys (8 bits per pass) in descending order,
+// the same order as do_quickysorty() gives for the unique keys
+static void SortRadix(SORT_ITEM *items, SORT_ITEM *scratch, DWORD count) {
+	DWORD hist[sizeof(items->_1)][256];
+	SORT_ITEM *src = items;
+	SORT_ITEM *dst = scratch;
+	SORT_ITEM *swapBuf;
+
+	memset(hist, 0, sizeof(hist));
+	for( DWORD i = 0; i < count; ++i ) {
+		for( DWORD pass = 0; pass < sizeof(items->_1); ++pass ) {
+			++hist[pass][(BYTE)(items[i]._1 >> (pass * 8))];
+		}
+	}
+
+	for( DWORD pass = 0; pass < sizeof(items->_1); ++pass ) {
+		DWORD *offsets = hist[pass];
+		DWORD shift = pass * 8;
+
+		// all keys have the same digit, so this pass changes nothing
+		if( offsets[(BYTE)(src[0]._1 >> shift)] == count ) continue;
+
+		// the highest digit goes first
+		DWORD total = 0;
+		for( int digit = 255; digit >= 0; --digit ) {
+			DWORD num = offsets[digit];
+			offsets[digit] = total;
+			total += num;
+		}
+		for( DWORD i = 0; i < count; ++i ) {
+			dst[offsets[(BYTE)(src[i]._1 >> shift)]++] = src[i];
+		}
+		SWAP(src, dst, swapBuf);
+	}
+
+	if( src != items ) {
+		memcpy(items, src, sizeof(SORT_ITEM) * count);
+	}
+}
+
+static void SortPolyItems(SORT_ITEM *items, DWORD count) {
+#ifdef FEATURE_EXTENDED_LIMITS
+	SORT_ITEM *scratch = GetSortScratch(count);
+	if( scratch == NULL ) {
+		do_quickysorty(0, count-1);
+		return;
+	}
+#else // FEATURE_EXTENDED_LIMITS
+	SORT_ITEM *scratch = SortScratch;
+#endif // FEATURE_EXTENDED_LIMITS
+	if( count < SORT_INSERTION_LIMIT ) {
+		SortInsertion(items, count);
+	} else {
+		SortRadix(items, scratch, count);
+	}
+}
+#endif // defined(FEATURE_RENDER_IMPROVED) && defined(FEATURE_VIEW_IMPROVED)
+
 void __cdecl phd_SortPolyList() {
+	BENCH_START(BENCH_Sort);
 	if( SurfaceCount ) {
 		for( DWORD i=0; i<SurfaceCount; ++i ) {
 #ifdef FEATURE_VIEW_IMPROVED
@@ -901,8 +1117,13 @@ void __cdecl phd_SortPolyList() {
 #endif // FEATURE_VIEW_IMPROVED
 			SortBuffer[i]._1 += i;
 		}
+#if defined(FEATURE_RENDER_IMPROVED) && defined(FEATURE_VIEW_IMPROVED)
+		SortPolyItems(SortBuffer, SurfaceCount);
+#else // defined(FEATURE_RENDER_IMPROVED) && defined(FEATURE_VIEW_IMPROVED)
 		do_quickysorty(0, SurfaceCount-1);
+#endif // defined(FEATURE_RENDER_IMPROVED) && defined(FEATURE_VIEW_IMPROVED)
 	}
+	BENCH_STOP(BENCH_Sort);
 }
 
 void __cdecl do_quickysorty(int left, int right) {
@@ -935,6 +1156,11 @@ void __cdecl phd_PrintPolyList(BYTE *surfacePtr) {
 	__int16 polyType, *bufPtr;
 	PrintSurfacePtr = surfacePtr;
 
+#ifdef FEATURE_RENDER_IMPROVED
+	if( SWR_PrintPolyListTiled(PolyDrawRoutines) ) {
+		return;
+	}
+#endif // FEATURE_RENDER_IMPROVED
 	for( DWORD i=0; i<SurfaceCount; ++i ) {
 		bufPtr = (__int16 *)SortBuffer[i]._0;
 		polyType = *(bufPtr++); // poly has type as routine index in first word
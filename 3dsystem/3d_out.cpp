@@ -21,6 +21,7 @@
 
 #include "global/precompiled.h"
 #include "3dsystem/3d_out.h"
+#include "3dsystem/3d_simd.h"
 #include "global/vars.h"
 
 #pragma pack(push, 1)
@@ -91,29 +92,131 @@ typedef struct {
 
 #pragma pack(pop)
 
+#ifdef FEATURE_EXTENDED_LIMITS
+// Edge buffer rows are read sequentially by the span fillers,
+// so the buffer starts on a cache line boundary
+#define SWR_EDGE_ALIGN (64)
+
+static void *EdgeBufferAlloc(int height) {
+	return _aligned_malloc(sizeof(XBUF_XGUVP) * height, SWR_EDGE_ALIGN);
+}
+
+static void EdgeBufferFree(void *buffer) {
+	_aligned_free(buffer);
+}
+#else // FEATURE_EXTENDED_LIMITS
+#define EdgeBufferAlloc(height) malloc(sizeof(XBUF_XGUVP) * (height))
+#define EdgeBufferFree(buffer) free(buffer)
+#endif // FEATURE_EXTENDED_LIMITS
+
 #ifdef FEATURE_NOLEGACY_OPTIONS
 static int SwrPitch = 0;
+#else // FEATURE_NOLEGACY_OPTIONS
+#define SwrPitch PhdScreenWidth // NOTE: this is the original game bug!
+#endif // FEATURE_NOLEGACY_OPTIONS
+
+#if defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
 static int SwrHeight = 0;
 static void *XBuffer = NULL;
 
+#ifdef FEATURE_NOLEGACY_OPTIONS
 int GetPitchSWR() {
     return SwrPitch;
 }
+#endif // FEATURE_NOLEGACY_OPTIONS
 
 void PrepareSWR(int pitch, int height) {
+#ifdef FEATURE_NOLEGACY_OPTIONS
 	if( pitch != 0 ) {
 		SwrPitch = pitch;
 	}
-    if( height != 0 && (XBuffer == NULL || SwrHeight != height) ) {
-		SwrHeight = height;
-		if( XBuffer != NULL ) free(XBuffer);
-		XBuffer = malloc(sizeof(XBUF_XGUVP) * height);
+#endif // FEATURE_NOLEGACY_OPTIONS
+	// The edge buffer is reallocated on resolution change only
+	if( height != 0 && (XBuffer == NULL || SwrHeight != height) ) {
+		if( XBuffer != NULL ) EdgeBufferFree(XBuffer);
+		XBuffer = EdgeBufferAlloc(height);
+		SwrHeight = ( XBuffer != NULL ) ? height : 0;
 	}
 }
-#else // FEATURE_NOLEGACY_OPTIONS
-#define SwrPitch PhdScreenWidth // NOTE: this is the original game bug!
+#else // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
 static int XBuffer[1200 * sizeof(XBUF_XGUVP) / sizeof(int)]; // maximum safe resolution is 1200 pixels
-#endif // FEATURE_NOLEGACY_OPTIONS
+#endif // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+
+#ifdef FEATURE_RENDER_IMPROVED
+// The main thread context uses the common XBuffer and has no clipping band
+static SWR_CONTEXT SwrMainContext = {NULL, 0, 0, 0, 0, 0x7FFFFFFF};
+static __thread SWR_CONTEXT *SwrThreadContext = NULL;
+
+SWR_CONTEXT *GetContextSWR() {
+	SWR_CONTEXT *ctx = SwrThreadContext;
+	if( ctx != NULL ) return ctx;
+	SwrMainContext.xBuffer = XBuffer;
+	return &SwrMainContext;
+}
+
+void SetThreadContextSWR(SWR_CONTEXT *ctx) {
+	SwrThreadContext = ctx;
+}
+
+bool AllocContextSWR(SWR_CONTEXT *ctx) {
+#if defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+	int height = SwrHeight;
+#else // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+	int height = 1200;
+#endif // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+	if( ctx->xBuffer != NULL && ctx->height == height ) {
+		return true;
+	}
+	if( ctx->xBuffer != NULL ) {
+		EdgeBufferFree(ctx->xBuffer);
+	}
+	ctx->xBuffer = EdgeBufferAlloc(height);
+	ctx->height = ( ctx->xBuffer != NULL ) ? height : 0;
+	return ( ctx->xBuffer != NULL );
+}
+
+void FreeContextSWR(SWR_CONTEXT *ctx) {
+	if( ctx->xBuffer != NULL ) {
+		EdgeBufferFree(ctx->xBuffer);
+		ctx->xBuffer = NULL;
+	}
+	ctx->height = 0;
+}
+
+#define SWR_CONTEXT_DECL	SWR_CONTEXT *ctx = GetContextSWR()
+#define SWR_XBUFFER			(ctx->xBuffer)
+#define SWR_XGEN_Y0			(ctx->xgenY0)
+#define SWR_XGEN_Y1			(ctx->xgenY1)
+// Spans are limited by the thread clipping band. Every scanline is independent,
+// so the band drawing gives the same pixels as the whole poly drawing.
+#define SWR_DRAW_Y0			(MAX(ctx->xgenY0, ctx->clipY0))
+#define SWR_DRAW_Y1			(MIN(ctx->xgenY1, ctx->clipY1))
+#else // FEATURE_RENDER_IMPROVED
+#define SWR_CONTEXT_DECL
+#define SWR_XBUFFER			XBuffer
+#define SWR_XGEN_Y0			XGen_y0
+#define SWR_XGEN_Y1			XGen_y1
+#define SWR_DRAW_Y0			XGen_y0
+#define SWR_DRAW_Y1			XGen_y1
+#endif // FEATURE_RENDER_IMPROVED
+
+#ifdef FEATURE_RENDER_IMPROVED
+// Clips the edge rows to the thread clipping band, so every tile generates
+// its own rows only. Returns the number of rows skipped from the edge start,
+// and changes the row count to the number of rows left.
+static inline int ClipEdgeRows(SWR_CONTEXT *ctx, int y, int *ySize) {
+	int skip = MAX(ctx->clipY0 - y, 0);
+	*ySize = MIN(y + *ySize, ctx->clipY1) - y - skip;
+	return skip;
+}
+#endif // FEATURE_RENDER_IMPROVED
+
+#if defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+// The edge buffer is missing until the first PrepareSWR call
+#define SWR_EDGE_CHECK		{if( SWR_XBUFFER == NULL ) return FALSE;}
+#else // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+#define SWR_EDGE_CHECK
+#endif // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
 
 void __cdecl draw_poly_line(__int16 *bufPtr) {
 	int i, j;
@@ -170,6 +273,14 @@ void __cdecl draw_poly_line(__int16 *bufPtr) {
 	xSize = x1 - x0;
 	ySize = y1 - y0;
 
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the rows of the thread clipping band are drawn
+	SWR_CONTEXT_DECL;
+	int y, yColAdd, yRowAdd;
+	if( MAX(y0, y1) < ctx->clipY0 || MIN(y0, y1) >= ctx->clipY1 )
+		return;
+#endif // FEATURE_RENDER_IMPROVED
+
 	if( (xSize|ySize) == 0 ) {
 		*drawPtr = colorIdx;
 		return;
@@ -204,6 +315,23 @@ void __cdecl draw_poly_line(__int16 *bufPtr) {
 	partTotal = 0;
 	part = PHD_ONE * j / i;
 
+#ifdef FEATURE_RENDER_IMPROVED
+	y = y0;
+	yColAdd = ( colAdd == yAdd ) ? ( yAdd < 0 ? -1 : 1 ) : 0;
+	yRowAdd = ( rowAdd == yAdd ) ? ( yAdd < 0 ? -1 : 1 ) : 0;
+	while( i-- ) {
+		partTotal += part;
+		if( y >= ctx->clipY0 && y < ctx->clipY1 )
+			*drawPtr = colorIdx;
+		drawPtr += colAdd;
+		y += yColAdd;
+		if( partTotal >= PHD_ONE ) {
+			drawPtr += rowAdd;
+			y += yRowAdd;
+			partTotal -= PHD_ONE;
+		}
+	}
+#else // FEATURE_RENDER_IMPROVED
 	while( i-- ) {
 		partTotal += part;
 		*drawPtr = colorIdx;
@@ -213,34 +341,41 @@ void __cdecl draw_poly_line(__int16 *bufPtr) {
 			partTotal -= PHD_ONE;
 		}
 	}
+#endif // FEATURE_RENDER_IMPROVED
 }
 
 void __cdecl draw_poly_flat(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_x(bufPtr + 1) )
-		flatA(XGen_y0, XGen_y1, *bufPtr);
+		flatA(SWR_DRAW_Y0, SWR_DRAW_Y1, *bufPtr);
 }
 
 void __cdecl draw_poly_trans(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_x(bufPtr + 1) )
-		transA(XGen_y0, XGen_y1, *bufPtr);
+		transA(SWR_DRAW_Y0, SWR_DRAW_Y1, *bufPtr);
 }
 
 void __cdecl draw_poly_gouraud(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_xg(bufPtr + 1) )
-		gourA(XGen_y0, XGen_y1, *bufPtr);
+		gourA(SWR_DRAW_Y0, SWR_DRAW_Y1, *bufPtr);
 }
 
 void __cdecl draw_poly_gtmap(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_xguv(bufPtr + 1) )
-		gtmapA(XGen_y0, XGen_y1, TexturePageBuffer8[*bufPtr]);
+		gtmapA(SWR_DRAW_Y0, SWR_DRAW_Y1, TexturePageBuffer8[*bufPtr]);
 }
 
 void __cdecl draw_poly_wgtmap(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_xguv(bufPtr + 1) )
-		wgtmapA(XGen_y0, XGen_y1, TexturePageBuffer8[*bufPtr]);
+		wgtmapA(SWR_DRAW_Y0, SWR_DRAW_Y1, TexturePageBuffer8[*bufPtr]);
 }
 
 BOOL __cdecl xgen_x(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	int ptCount;
 	XGEN_X *pt1, *pt2;
 	int yMin, yMax;
@@ -249,6 +384,7 @@ BOOL __cdecl xgen_x(__int16 *bufPtr) {
 	int x, xAdd;
 	XBUF_X *xPtr;
 
+	SWR_EDGE_CHECK;
 	ptCount = *bufPtr++;
 	pt2 = (XGEN_X *)bufPtr;
 	pt1 = pt2 + (ptCount - 1);
@@ -267,9 +403,15 @@ BOOL __cdecl xgen_x(__int16 *bufPtr) {
 			xSize = x2 - x1;
 			ySize = y2 - y1;
 
-			xPtr = (XBUF_X *)XBuffer + y1;
+			xPtr = (XBUF_X *)SWR_XBUFFER + y1;
 			xAdd = PHD_ONE * xSize / ySize;
 			x = x1 * PHD_ONE + (PHD_ONE - 1);
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y1, &ySize);
+			if( ySize <= 0 ) continue;
+			xPtr += skip;
+			x += skip * xAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				(xPtr++)->x1 = (x += xAdd);
@@ -280,9 +422,15 @@ BOOL __cdecl xgen_x(__int16 *bufPtr) {
 			xSize = x1 - x2;
 			ySize = y1 - y2;
 
-			xPtr = (XBUF_X *)XBuffer + y2;
+			xPtr = (XBUF_X *)SWR_XBUFFER + y2;
 			xAdd = PHD_ONE * xSize / ySize;
 			x = x2 * PHD_ONE + 1;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y2, &ySize);
+			if( ySize <= 0 ) continue;
+			xPtr += skip;
+			x += skip * xAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				(xPtr++)->x0 = (x += xAdd);
@@ -293,12 +441,13 @@ BOOL __cdecl xgen_x(__int16 *bufPtr) {
 	if( yMin == yMax )
 		return FALSE;
 
-	XGen_y0 = yMin;
-	XGen_y1 = yMax;
+	SWR_XGEN_Y0 = yMin;
+	SWR_XGEN_Y1 = yMax;
 	return TRUE;
 }
 
 BOOL __cdecl xgen_xg(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	int ptCount;
 	XGEN_XG *pt1, *pt2;
 	int yMin, yMax;
@@ -307,6 +456,7 @@ BOOL __cdecl xgen_xg(__int16 *bufPtr) {
 	int x, g, xAdd, gAdd;
 	XBUF_XG *xgPtr;
 
+	SWR_EDGE_CHECK;
 	ptCount = *bufPtr++;
 	pt2 = (XGEN_XG *)bufPtr;
 	pt1 = pt2 + (ptCount - 1);
@@ -328,11 +478,18 @@ BOOL __cdecl xgen_xg(__int16 *bufPtr) {
 			ySize = y2 - y1;
 			gSize = g2 - g1;
 
-			xgPtr = (XBUF_XG *)XBuffer + y1;
+			xgPtr = (XBUF_XG *)SWR_XBUFFER + y1;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			x = x1 * PHD_ONE + (PHD_ONE - 1);
 			g = g1 * PHD_HALF;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y1, &ySize);
+			if( ySize <= 0 ) continue;
+			xgPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				xgPtr->x1 = (x += xAdd);
@@ -346,11 +503,18 @@ BOOL __cdecl xgen_xg(__int16 *bufPtr) {
 			ySize = y1 - y2;
 			gSize = g1 - g2;
 
-			xgPtr = (XBUF_XG *)XBuffer + y2;
+			xgPtr = (XBUF_XG *)SWR_XBUFFER + y2;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			x = x2 * PHD_ONE + 1;
 			g = g2 * PHD_HALF;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y2, &ySize);
+			if( ySize <= 0 ) continue;
+			xgPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				xgPtr->x0 = (x += xAdd);
@@ -363,12 +527,13 @@ BOOL __cdecl xgen_xg(__int16 *bufPtr) {
 	if( yMin == yMax )
 		return FALSE;
 
-	XGen_y0 = yMin;
-	XGen_y1 = yMax;
+	SWR_XGEN_Y0 = yMin;
+	SWR_XGEN_Y1 = yMax;
 	return TRUE;
 }
 
 BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	int ptCount;
 	XGEN_XGUV *pt1, *pt2;
 	int yMin, yMax;
@@ -377,6 +542,7 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 	int x, g, u, v, xAdd, gAdd, uAdd, vAdd;
 	XBUF_XGUV *xguvPtr;
 
+	SWR_EDGE_CHECK;
 	ptCount = *bufPtr++;
 	pt2 = (XGEN_XGUV *)bufPtr;
 	pt1 = pt2 + (ptCount - 1);
@@ -404,7 +570,7 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 			uSize = u2 - u1;
 			vSize = v2 - v1;
 
-			xguvPtr = (XBUF_XGUV *)XBuffer + y1;
+			xguvPtr = (XBUF_XGUV *)SWR_XBUFFER + y1;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			uAdd = PHD_HALF * uSize / ySize;
@@ -413,6 +579,15 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 			g = g1 * PHD_HALF;
 			u = u1 * PHD_HALF;
 			v = v1 * PHD_HALF;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y1, &ySize);
+			if( ySize <= 0 ) continue;
+			xguvPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+			u += skip * uAdd;
+			v += skip * vAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				xguvPtr->x1 = (x += xAdd);
@@ -430,7 +605,7 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 			uSize = u1 - u2;
 			vSize = v1 - v2;
 
-			xguvPtr = (XBUF_XGUV *)XBuffer + y2;
+			xguvPtr = (XBUF_XGUV *)SWR_XBUFFER + y2;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			uAdd = PHD_HALF * uSize / ySize;
@@ -439,6 +614,15 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 			g = g2 * PHD_HALF;
 			u = u2 * PHD_HALF;
 			v = v2 * PHD_HALF;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y2, &ySize);
+			if( ySize <= 0 ) continue;
+			xguvPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+			u += skip * uAdd;
+			v += skip * vAdd;
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				xguvPtr->x0 = (x += xAdd);
@@ -453,12 +637,13 @@ BOOL __cdecl xgen_xguv(__int16 *bufPtr) {
 	if( yMin == yMax )
 		return FALSE;
 
-	XGen_y0 = yMin;
-	XGen_y1 = yMax;
+	SWR_XGEN_Y0 = yMin;
+	SWR_XGEN_Y1 = yMax;
 	return TRUE;
 }
 
 BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	int ptCount;
 	XGEN_XGUVP *pt1, *pt2;
 	int yMin, yMax;
@@ -470,6 +655,7 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 	float u, v, rhw, uAdd, vAdd, rhwAdd;
 	XBUF_XGUVP *xguvPtr;
 
+	SWR_EDGE_CHECK;
 	ptCount = *bufPtr++;
 	pt2 = (XGEN_XGUVP *)bufPtr;
 	pt1 = pt2 + (ptCount - 1);
@@ -500,7 +686,7 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 			vSize = v2 - v1;
 			rhwSize = rhw2 - rhw1;
 
-			xguvPtr = (XBUF_XGUVP *)XBuffer + y1;
+			xguvPtr = (XBUF_XGUVP *)SWR_XBUFFER + y1;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			uAdd = uSize / (float)ySize;
@@ -511,6 +697,19 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 			u = u1;
 			v = v1;
 			rhw = rhw1;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y1, &ySize);
+			if( ySize <= 0 ) continue;
+			xguvPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+			// the float steps are repeated to get the same rounding as the whole edge
+			for( ; skip > 0; --skip ) {
+				u += uAdd;
+				v += vAdd;
+				rhw += rhwAdd;
+			}
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
  				xguvPtr->x1 = (x += xAdd);
@@ -530,7 +729,7 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 			vSize = v1 - v2;
 			rhwSize = rhw1 - rhw2;
 
-			xguvPtr = (XBUF_XGUVP *)XBuffer + y2;
+			xguvPtr = (XBUF_XGUVP *)SWR_XBUFFER + y2;
 			xAdd = PHD_ONE * xSize / ySize;
 			gAdd = PHD_HALF * gSize / ySize;
 			uAdd = (float)uSize / (float)ySize;
@@ -541,6 +740,19 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 			u = (float)u2;
 			v = (float)v2;
 			rhw = (float)rhw2;
+#ifdef FEATURE_RENDER_IMPROVED
+			int skip = ClipEdgeRows(ctx, y2, &ySize);
+			if( ySize <= 0 ) continue;
+			xguvPtr += skip;
+			x += skip * xAdd;
+			g += skip * gAdd;
+			// the float steps are repeated to get the same rounding as the whole edge
+			for( ; skip > 0; --skip ) {
+				u += uAdd;
+				v += vAdd;
+				rhw += rhwAdd;
+			}
+#endif // FEATURE_RENDER_IMPROVED
 
 			do {
 				xguvPtr->x0 = (x += xAdd);
@@ -556,12 +768,13 @@ BOOL __cdecl xgen_xguvpersp_fp(__int16 *bufPtr) {
 	if( yMin == yMax )
 		return FALSE;
 
-	XGen_y0 = yMin;
-	XGen_y1 = yMax;
+	SWR_XGEN_Y0 = yMin;
+	SWR_XGEN_Y1 = yMax;
 	return TRUE;
 }
 
 void __cdecl gtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
+	SWR_CONTEXT_DECL;
 	int batchSize, batchCounter;
 	int x, xSize, ySize;
 	int g, u0, u1, v0, v1, gAdd, u0Add, v0Add;
@@ -574,7 +787,7 @@ void __cdecl gtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_XGUVP *)XBuffer + y0;
+	xbuf = (XBUF_XGUVP *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 
 	for( ; ySize > 0; --ySize, ++xbuf, drawPtr += SwrPitch ) {
@@ -612,6 +825,14 @@ void __cdecl gtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 				u0Add = (u1 - u0) / batchSize;
 				v0Add = (v1 - v0) / batchSize;
 
+#ifdef FEATURE_SIMD_RENDER
+				if( SpanGTMapPersp != NULL ) {
+					g = SpanGTMapPersp(linePtr, batchSize, g, gAdd, u0, u0Add, v0, v0Add, texPage, (BYTE *)DepthQTable);
+					u0 += u0Add * batchSize;
+					v0 += v0Add * batchSize;
+					linePtr += batchSize;
+				} else
+#endif // FEATURE_SIMD_RENDER
 				if( (ABS(u0Add) + ABS(v0Add)) < (PHD_ONE / 2) ) {
 					batchCounter = batchSize / 2;
 					do {
@@ -649,6 +870,14 @@ void __cdecl gtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 			batchSize = xSize & ~1;
 			xSize -= batchSize;
 
+#ifdef FEATURE_SIMD_RENDER
+			if( SpanGTMapPersp != NULL ) {
+				g = SpanGTMapPersp(linePtr, batchSize, g, gAdd, u0, u0Add, v0, v0Add, texPage, (BYTE *)DepthQTable);
+				u0 += u0Add * batchSize;
+				v0 += v0Add * batchSize;
+				linePtr += batchSize;
+			} else
+#endif // FEATURE_SIMD_RENDER
 			if( (ABS(u0Add) + ABS(v0Add)) < (PHD_ONE / 2) ) {
 				batchCounter = batchSize / 2;
 				do {
@@ -680,6 +909,7 @@ void __cdecl gtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 }
 
 void __cdecl wgtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
+	SWR_CONTEXT_DECL;
 	int batchSize, batchCounter;
 	int x, xSize, ySize;
 	int g, u0, u1, v0, v1, gAdd, u0Add, v0Add;
@@ -692,7 +922,7 @@ void __cdecl wgtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_XGUVP *)XBuffer + y0;
+	xbuf = (XBUF_XGUVP *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 
 	for( ; ySize > 0; --ySize, ++xbuf, drawPtr += SwrPitch ) {
@@ -730,6 +960,14 @@ void __cdecl wgtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 				u0Add = (u1 - u0) / batchSize;
 				v0Add = (v1 - v0) / batchSize;
 
+#ifdef FEATURE_SIMD_RENDER
+				if( SpanWGTMapPersp != NULL ) {
+					g = SpanWGTMapPersp(linePtr, batchSize, g, gAdd, u0, u0Add, v0, v0Add, texPage, (BYTE *)DepthQTable);
+					u0 += u0Add * batchSize;
+					v0 += v0Add * batchSize;
+					linePtr += batchSize;
+				} else
+#endif // FEATURE_SIMD_RENDER
 				if( (ABS(u0Add) + ABS(v0Add)) < (PHD_ONE / 2) ) {
 					batchCounter = batchSize / 2;
 					do {
@@ -773,6 +1011,14 @@ void __cdecl wgtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 			batchSize = xSize & ~1;
 			xSize -= batchSize;
 
+#ifdef FEATURE_SIMD_RENDER
+			if( SpanWGTMapPersp != NULL ) {
+				g = SpanWGTMapPersp(linePtr, batchSize, g, gAdd, u0, u0Add, v0, v0Add, texPage, (BYTE *)DepthQTable);
+				u0 += u0Add * batchSize;
+				v0 += v0Add * batchSize;
+				linePtr += batchSize;
+			} else
+#endif // FEATURE_SIMD_RENDER
 			if( (ABS(u0Add) + ABS(v0Add)) < (PHD_ONE / 2) ) {
 				batchCounter = batchSize / 2;
 				do {
@@ -812,16 +1058,19 @@ void __cdecl wgtmap_persp32_fp(int y0, int y1, BYTE *texPage) {
 }
 
 void __cdecl draw_poly_gtmap_persp(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_xguvpersp_fp(bufPtr + 1) )
-		gtmap_persp32_fp(XGen_y0, XGen_y1, TexturePageBuffer8[*bufPtr]);
+		gtmap_persp32_fp(SWR_DRAW_Y0, SWR_DRAW_Y1, TexturePageBuffer8[*bufPtr]);
 }
 
 void __cdecl draw_poly_wgtmap_persp(__int16 *bufPtr) {
+	SWR_CONTEXT_DECL;
 	if( xgen_xguvpersp_fp(bufPtr + 1) )
-		wgtmap_persp32_fp(XGen_y0, XGen_y1, TexturePageBuffer8[*bufPtr]);
+		wgtmap_persp32_fp(SWR_DRAW_Y0, SWR_DRAW_Y1, TexturePageBuffer8[*bufPtr]);
 }
 
 void __fastcall flatA(int y0, int y1, BYTE colorIdx) {
+	SWR_CONTEXT_DECL;
 	int x, xSize, ySize;
 	BYTE *drawPtr;
 	XBUF_X *xbuf;
@@ -830,7 +1079,7 @@ void __fastcall flatA(int y0, int y1, BYTE colorIdx) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_X *)XBuffer + y0;
+	xbuf = (XBUF_X *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 
 	for( ; ySize > 0; --ySize, ++xbuf, drawPtr += SwrPitch ) {
@@ -843,6 +1092,7 @@ void __fastcall flatA(int y0, int y1, BYTE colorIdx) {
 }
 
 void __fastcall transA(int y0, int y1, BYTE depthQ) {
+	SWR_CONTEXT_DECL;
 	int x, xSize, ySize;
 	BYTE *drawPtr, *linePtr;
 	XBUF_X *xbuf;
@@ -852,7 +1102,7 @@ void __fastcall transA(int y0, int y1, BYTE depthQ) {
 	if( ySize <= 0 || depthQ >= 32 ) // NOTE: depthQ check was ( > 32) in the original code
 		return;
 
-	xbuf = (XBUF_X *)XBuffer + y0;
+	xbuf = (XBUF_X *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 	qt = DepthQTable + depthQ;
 
@@ -871,6 +1121,7 @@ void __fastcall transA(int y0, int y1, BYTE depthQ) {
 }
 
 void __fastcall gourA(int y0, int y1, BYTE colorIdx) {
+	SWR_CONTEXT_DECL;
 	int x, xSize, ySize;
 	int g, gAdd;
 	BYTE *drawPtr, *linePtr;
@@ -881,7 +1132,7 @@ void __fastcall gourA(int y0, int y1, BYTE colorIdx) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_XG *)XBuffer + y0;
+	xbuf = (XBUF_XG *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 	gt = GouraudTable + colorIdx;
 
@@ -903,6 +1154,7 @@ void __fastcall gourA(int y0, int y1, BYTE colorIdx) {
 }
 
 void __fastcall gtmapA(int y0, int y1, BYTE *texPage) {
+	SWR_CONTEXT_DECL;
 	int x, xSize, ySize;
 	int g, u, v, gAdd, uAdd, vAdd;
 	BYTE *drawPtr, *linePtr;
@@ -913,7 +1165,7 @@ void __fastcall gtmapA(int y0, int y1, BYTE *texPage) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_XGUV *)XBuffer + y0;
+	xbuf = (XBUF_XGUV *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 
 	for( ; ySize > 0; --ySize, ++xbuf, drawPtr += SwrPitch ) {
@@ -941,6 +1193,7 @@ void __fastcall gtmapA(int y0, int y1, BYTE *texPage) {
 }
 
 void __fastcall wgtmapA(int y0, int y1, BYTE *texPage) {
+	SWR_CONTEXT_DECL;
 	int x, xSize, ySize;
 	int g, u, v, gAdd, uAdd, vAdd;
 	BYTE *drawPtr, *linePtr;
@@ -951,7 +1204,7 @@ void __fastcall wgtmapA(int y0, int y1, BYTE *texPage) {
 	if( ySize <= 0 )
 		return;
 
-	xbuf = (XBUF_XGUV *)XBuffer + y0;
+	xbuf = (XBUF_XGUV *)SWR_XBUFFER + y0;
 	drawPtr = PrintSurfacePtr + y0 * SwrPitch;
 
 	for( ; ySize > 0; --ySize, ++xbuf, drawPtr += SwrPitch ) {
@@ -27,6 +27,13 @@
 /*
  * Function list
  */
+#ifdef FEATURE_RENDER_IMPROVED
+SWR_CONTEXT *GetContextSWR();
+void SetThreadContextSWR(SWR_CONTEXT *ctx);
+bool AllocContextSWR(SWR_CONTEXT *ctx);
+void FreeContextSWR(SWR_CONTEXT *ctx);
+#endif // FEATURE_RENDER_IMPROVED
+
 void __cdecl draw_poly_line(__int16 *bufPtr); // 0x00402960
 void __cdecl draw_poly_flat(__int16 *bufPtr); // 0x00402B00
 void __cdecl draw_poly_trans(__int16 *bufPtr); // 0x00402B40
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "3dsystem/3d_simd.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_SIMD_RENDER
+#include <immintrin.h>
+
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+
+static int SimdLevel = -1;
+
+SIMD_LEVEL GetSimdLevel() {
+	if( SimdLevel < 0 ) {
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("avx2") ) {
+			SimdLevel = SIMD_AVX2;
+		} else if( __builtin_cpu_supports("sse2") ) {
+			SimdLevel = SIMD_SSE2;
+		} else {
+			SimdLevel = SIMD_None;
+		}
+	}
+	return (SIMD_LEVEL)SimdLevel;
+}
+
+// pmaddwd multiplies signed 16-bit pairs and sums them into 32 bits.
+// The sum overflows only for -32768*-32768 twice, so this value is excluded.
+static bool IsMatrixPackable(PHD_MATRIX *m) {
+	int rot[9] = {
+		m->_00, m->_01, m->_02,
+		m->_10, m->_11, m->_12,
+		m->_20, m->_21, m->_22,
+	};
+	for( int i = 0; i < 9; ++i ) {
+		if( rot[i] < -0x7FFF || rot[i] > 0x7FFF ) return false;
+	}
+	return true;
+}
+
+static void TransformScalar(__int16 *ptrObj, int start, int vtxCount, int stride, PHD_MATRIX *m, VTX_STAGE *stage) {
+	for( int i = start; i < vtxCount; ++i ) {
+		stage->xv[i] = m->_00 * ptrObj[0] + m->_01 * ptrObj[1] + m->_02 * ptrObj[2] + m->_03;
+		stage->yv[i] = m->_10 * ptrObj[0] + m->_11 * ptrObj[1] + m->_12 * ptrObj[2] + m->_13;
+		stage->zv[i] = m->_20 * ptrObj[0] + m->_21 * ptrObj[1] + m->_22 * ptrObj[2] + m->_23;
+		ptrObj += stride;
+	}
+}
+
+static SIMD_TARGET("sse2") int TransformSSE2(__int16 *ptrObj, int vtxCount, int stride, PHD_MATRIX *m, VTX_STAGE *stage) {
+	__m128i xy0 = _mm_set_epi16(m->_01, m->_00, m->_01, m->_00, m->_01, m->_00, m->_01, m->_00);
+	__m128i xy1 = _mm_set_epi16(m->_11, m->_10, m->_11, m->_10, m->_11, m->_10, m->_11, m->_10);
+	__m128i xy2 = _mm_set_epi16(m->_21, m->_20, m->_21, m->_20, m->_21, m->_20, m->_21, m->_20);
+	__m128i z0 = _mm_set_epi16(0, m->_02, 0, m->_02, 0, m->_02, 0, m->_02);
+	__m128i z1 = _mm_set_epi16(0, m->_12, 0, m->_12, 0, m->_12, 0, m->_12);
+	__m128i z2 = _mm_set_epi16(0, m->_22, 0, m->_22, 0, m->_22, 0, m->_22);
+	__m128i t0 = _mm_set1_epi32(m->_03);
+	__m128i t1 = _mm_set1_epi32(m->_13);
+	__m128i t2 = _mm_set1_epi32(m->_23);
+	__int16 *p0, *p1, *p2, *p3;
+	int i;
+
+	for( i = 0; i + 4 <= vtxCount; i += 4 ) {
+		p0 = ptrObj; p1 = p0 + stride; p2 = p1 + stride; p3 = p2 + stride;
+		__m128i xy = _mm_set_epi16(p3[1], p3[0], p2[1], p2[0], p1[1], p1[0], p0[1], p0[0]);
+		__m128i zz = _mm_set_epi16(0, p3[2], 0, p2[2], 0, p1[2], 0, p0[2]);
+		__m128i xv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(xy, xy0), _mm_madd_epi16(zz, z0)), t0);
+		__m128i yv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(xy, xy1), _mm_madd_epi16(zz, z1)), t1);
+		__m128i zv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(xy, xy2), _mm_madd_epi16(zz, z2)), t2);
+		_mm_storeu_si128((__m128i *)&stage->xv[i], xv);
+		_mm_storeu_si128((__m128i *)&stage->yv[i], yv);
+		_mm_storeu_si128((__m128i *)&stage->zv[i], zv);
+		ptrObj += 4 * stride;
+	}
+	return i;
+}
+
+static SIMD_TARGET("avx2") int TransformAVX2(__int16 *ptrObj, int vtxCount, int stride, PHD_MATRIX *m, VTX_STAGE *stage) {
+	__m256i xy0 = _mm256_set1_epi32(((DWORD)m->_01 << 16) | (m->_00 & 0xFFFF));
+	__m256i xy1 = _mm256_set1_epi32(((DWORD)m->_11 << 16) | (m->_10 & 0xFFFF));
+	__m256i xy2 = _mm256_set1_epi32(((DWORD)m->_21 << 16) | (m->_20 & 0xFFFF));
+	__m256i z0 = _mm256_set1_epi32(m->_02 & 0xFFFF);
+	__m256i z1 = _mm256_set1_epi32(m->_12 & 0xFFFF);
+	__m256i z2 = _mm256_set1_epi32(m->_22 & 0xFFFF);
+	__m256i t0 = _mm256_set1_epi32(m->_03);
+	__m256i t1 = _mm256_set1_epi32(m->_13);
+	__m256i t2 = _mm256_set1_epi32(m->_23);
+	int xyBuf[8], zBuf[8];
+	int i, j;
+
+	for( i = 0; i + 8 <= vtxCount; i += 8 ) {
+		for( j = 0; j < 8; ++j ) {
+			xyBuf[j] = ((DWORD)(UINT16)ptrObj[1] << 16) | (UINT16)ptrObj[0];
+			zBuf[j] = (UINT16)ptrObj[2];
+			ptrObj += stride;
+		}
+		__m256i xy = _mm256_loadu_si256((__m256i *)xyBuf);
+		__m256i zz = _mm256_loadu_si256((__m256i *)zBuf);
+		__m256i xv = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(xy, xy0), _mm256_madd_epi16(zz, z0)), t0);
+		__m256i yv = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(xy, xy1), _mm256_madd_epi16(zz, z1)), t1);
+		__m256i zv = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(xy, xy2), _mm256_madd_epi16(zz, z2)), t2);
+		_mm256_storeu_si256((__m256i *)&stage->xv[i], xv);
+		_mm256_storeu_si256((__m256i *)&stage->yv[i], yv);
+		_mm256_storeu_si256((__m256i *)&stage->zv[i], zv);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+/*
+ * Transforms up to VTX_STAGE_SIZE vertices by PhdMatrixPtr into the
+ * structure-of-arrays stage. Integer results are exactly the same as
+ * the scalar PhdMatrixPtr math, so the following projection pass gives
+ * the same output as the original per-vertex code.
+ */
+void VtxTransform(__int16 *ptrObj, int vtxCount, int stride, VTX_STAGE *stage) {
+	PHD_MATRIX *m = PhdMatrixPtr;
+	int done = 0;
+
+	CLAMPG(vtxCount, VTX_STAGE_SIZE);
+	if( IsMatrixPackable(m) ) {
+		switch( GetSimdLevel() ) {
+			case SIMD_AVX2 :
+				done = TransformAVX2(ptrObj, vtxCount, stride, m, stage);
+				break;
+			case SIMD_SSE2 :
+				done = TransformSSE2(ptrObj, vtxCount, stride, m, stage);
+				break;
+			default :
+				break;
+		}
+	}
+	TransformScalar(ptrObj + done * stride, done, vtxCount, stride, m, stage);
+}
+
+// Gathers 8 bytes at the byte offsets. Every dword is read at an aligned
+// offset, so the read never goes out of the 256 byte aligned table block.
+static SIMD_TARGET("avx2") __m256i GatherBytesAVX2(BYTE *base, __m256i offset) {
+	__m256i dword = _mm256_i32gather_epi32((const int *)base, _mm256_andnot_si256(_mm256_set1_epi32(3), offset), 1);
+	__m256i shift = _mm256_slli_epi32(_mm256_and_si256(offset, _mm256_set1_epi32(3)), 3);
+	return _mm256_and_si256(_mm256_srlv_epi32(dword, shift), _mm256_set1_epi32(0xFF));
+}
+
+// Packs 8 dwords (0..255) into the low 8 bytes
+static SIMD_TARGET("avx2") __m128i PackBytesAVX2(__m256i value) {
+	__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+	return _mm_packus_epi16(words, words);
+}
+
+static SIMD_TARGET("avx2") int SpanPerspAVX2(BYTE *dst, int pixels, int g, int gAdd, int u, int uAdd, int v, int vAdd, BYTE *texPage, BYTE *depthQ, bool transparent) {
+	// The same texel is drawn twice if the texture step is small enough
+	bool pair = ( (ABS(uAdd) + ABS(vAdd)) < (PHD_ONE / 2) );
+	int step = pair ? 2 : 1;
+	int samples = pixels / step;
+	DWORD gStep = (DWORD)gAdd * step;
+	DWORD uStep = (DWORD)uAdd * step;
+	DWORD vStep = (DWORD)vAdd * step;
+	__m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i gv = _mm256_add_epi32(_mm256_set1_epi32(g), _mm256_mullo_epi32(lane, _mm256_set1_epi32(gStep)));
+	__m256i uv = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lane, _mm256_set1_epi32(uStep)));
+	__m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lane, _mm256_set1_epi32(vStep)));
+	__m256i gv8 = _mm256_set1_epi32(gStep * 8);
+	__m256i uv8 = _mm256_set1_epi32(uStep * 8);
+	__m256i vv8 = _mm256_set1_epi32(vStep * 8);
+	__m256i byteMask = _mm256_set1_epi32(0xFF);
+	BYTE colorIdx;
+	int i;
+
+	for( i = 0; i + 8 <= samples; i += 8 ) {
+		__m256i texOffset = _mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(vv, 16), byteMask), 8),
+			_mm256_and_si256(_mm256_srli_epi32(uv, 16), byteMask));
+		__m256i texel = GatherBytesAVX2(texPage, texOffset);
+		__m256i depthOffset = _mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(gv, 16), byteMask), 8),
+			texel);
+		__m128i color = PackBytesAVX2(GatherBytesAVX2(depthQ, depthOffset));
+		__m128i keep = _mm_cmpeq_epi8(PackBytesAVX2(texel), _mm_setzero_si128());
+
+		if( pair ) {
+			color = _mm_unpacklo_epi8(color, color);
+			if( transparent ) {
+				keep = _mm_unpacklo_epi8(keep, keep);
+				color = _mm_blendv_epi8(color, _mm_loadu_si128((__m128i *)dst), keep);
+			}
+			_mm_storeu_si128((__m128i *)dst, color);
+			dst += 16;
+		} else {
+			if( transparent ) {
+				color = _mm_blendv_epi8(color, _mm_loadl_epi64((__m128i *)dst), keep);
+			}
+			_mm_storel_epi64((__m128i *)dst, color);
+			dst += 8;
+		}
+		gv = _mm256_add_epi32(gv, gv8);
+		uv = _mm256_add_epi32(uv, uv8);
+		vv = _mm256_add_epi32(vv, vv8);
+	}
+	_mm256_zeroupper();
+
+	g = (DWORD)g + gStep * i;
+	u = (DWORD)u + uStep * i;
+	v = (DWORD)v + vStep * i;
+	for( ; i < samples; ++i ) {
+		colorIdx = texPage[BYTE2(v)*256 + BYTE2(u)];
+		if( !transparent || colorIdx != 0 ) {
+			colorIdx = depthQ[BYTE2(g)*256 + colorIdx];
+			dst[0] = colorIdx;
+			if( pair ) dst[1] = colorIdx;
+		}
+		dst += step;
+		g = (DWORD)g + gStep;
+		u = (DWORD)u + uStep;
+		v = (DWORD)v + vStep;
+	}
+	return g;
+}
+
+static int SpanGTMapPerspAVX2(BYTE *dst, int pixels, int g, int gAdd, int u, int uAdd, int v, int vAdd, BYTE *texPage, BYTE *depthQ) {
+	return SpanPerspAVX2(dst, pixels, g, gAdd, u, uAdd, v, vAdd, texPage, depthQ, false);
+}
+
+static int SpanWGTMapPerspAVX2(BYTE *dst, int pixels, int g, int gAdd, int u, int uAdd, int v, int vAdd, BYTE *texPage, BYTE *depthQ) {
+	return SpanPerspAVX2(dst, pixels, g, gAdd, u, uAdd, v, vAdd, texPage, depthQ, true);
+}
+
+SPAN_PERSP_FUNC SpanGTMapPersp = NULL;
+SPAN_PERSP_FUNC SpanWGTMapPersp = NULL;
+
+/*
+ * Picks the span kernels for the CPU. The kernels remain NULL if there
+ * is no suitable instruction set, so the original code is used.
+ */
+void SIMD_Init() {
+	switch( GetSimdLevel() ) {
+		case SIMD_AVX2 :
+			SpanGTMapPersp = SpanGTMapPerspAVX2;
+			SpanWGTMapPersp = SpanWGTMapPerspAVX2;
+			break;
+		default :
+			SpanGTMapPersp = NULL;
+			SpanWGTMapPersp = NULL;
+			break;
+	}
+}
+#endif // FEATURE_SIMD_RENDER
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _3DSIMD_H_INCLUDED
+#define _3DSIMD_H_INCLUDED
+
+#include "global/types.h"
+
+#ifdef FEATURE_SIMD_RENDER
+// Draws the affine part of the perspective span, returns the next shade
+typedef int (*SPAN_PERSP_FUNC)(BYTE *dst, int pixels, int g, int gAdd, int u, int uAdd, int v, int vAdd, BYTE *texPage, BYTE *depthQ);
+
+extern SPAN_PERSP_FUNC SpanGTMapPersp;
+extern SPAN_PERSP_FUNC SpanWGTMapPersp;
+#endif // FEATURE_SIMD_RENDER
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_SIMD_RENDER
+SIMD_LEVEL GetSimdLevel();
+void VtxTransform(__int16 *ptrObj, int vtxCount, int stride, VTX_STAGE *stage);
+void SIMD_Init();
+#endif // FEATURE_SIMD_RENDER
+
+#endif // _3DSIMD_H_INCLUDED
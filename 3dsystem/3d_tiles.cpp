@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include <float.h>
+#include "3dsystem/3d_tiles.h"
+#include "3dsystem/3d_out.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_RENDER_IMPROVED
+#define TILE_HEIGHT			(32)	// scanlines per tile
+#define TILE_MAX_THREADS	(8)		// the main thread is included
+#define TILE_MIN_POLYS		(256)	// fewer polys are drawn by the main thread only
+
+typedef struct {
+	DWORD *items;
+	DWORD count;
+	DWORD capacity;
+} TILE_BIN;
+
+typedef struct {
+	HANDLE thread;
+	HANDLE startEvent;
+	HANDLE doneEvent;
+	SWR_CONTEXT ctx;
+} TILE_WORKER;
+
+static void (__cdecl **TileDrawRoutines)(__int16 *) = NULL;
+static TILE_WORKER TileWorkers[TILE_MAX_THREADS - 1];
+static HANDLE TileDoneEvents[TILE_MAX_THREADS - 1];
+static SWR_CONTEXT TileMainContext;
+static int TileWorkersCount = -1; // -1 means the workers are not initialized yet
+static bool TileExit = false;
+
+static TILE_BIN *TileBins = NULL;
+static int TileBinsAllocated = 0;
+static int TileBinsCount = 0;
+static volatile LONG TileNext = 0;
+static unsigned int TileFpuControl = 0; // the main thread FPU control word
+
+// Every tile bin keeps the sort order of its polys
+static bool TileBinAdd(TILE_BIN *bin, DWORD idx) {
+	if( bin->count >= bin->capacity ) {
+		DWORD capacity = ( bin->capacity ) ? bin->capacity * 2 : 256;
+		DWORD *items = (DWORD *)realloc(bin->items, sizeof(DWORD) * capacity);
+		if( items == NULL ) return false;
+		bin->items = items;
+		bin->capacity = capacity;
+	}
+	bin->items[bin->count++] = idx;
+	return true;
+}
+
+// Gets the surface rows the poly may touch (the bounds are inclusive)
+static bool GetPolyRows(__int16 *bufPtr, int *yMin, int *yMax) {
+	int stride = 0;
+
+	switch( bufPtr[0] ) {
+		case POLY_flat :
+		case POLY_trans :
+			stride = 2; // XGEN_X
+			break;
+
+		case POLY_gouraud :
+			stride = 3; // XGEN_XG
+			break;
+
+		case POLY_GTmap :
+		case POLY_WGTmap :
+			stride = 5; // XGEN_XGUV
+			break;
+
+		case POLY_GTmap_persp :
+		case POLY_WGTmap_persp :
+			stride = 9; // XGEN_XGUVP
+			break;
+
+		case POLY_line :
+			*yMin = MIN(bufPtr[2], bufPtr[4]);
+			*yMax = MAX(bufPtr[2], bufPtr[4]);
+			return true;
+
+		case POLY_sprite :
+			*yMin = PhdWinMinY + bufPtr[2];
+			*yMax = PhdWinMinY + bufPtr[4];
+			return true;
+
+		default :
+			return false;
+	}
+
+	int ptCount = bufPtr[2];
+	UINT16 *pt = (UINT16 *)&bufPtr[3];
+	if( ptCount <= 0 ) return false;
+
+	*yMin = *yMax = pt[1];
+	for( int i = 1; i < ptCount; ++i ) {
+		pt += stride;
+		CLAMPG(*yMin, pt[1]);
+		CLAMPL(*yMax, pt[1]);
+	}
+	return true;
+}
+
+static bool BinPolyList() {
+	int height = TileMainContext.height;
+	int binsCount = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+	if( binsCount > TileBinsAllocated ) {
+		TILE_BIN *bins = (TILE_BIN *)realloc(TileBins, sizeof(TILE_BIN) * binsCount);
+		if( bins == NULL ) return false;
+		memset(&bins[TileBinsAllocated], 0, sizeof(TILE_BIN) * (binsCount - TileBinsAllocated));
+		TileBins = bins;
+		TileBinsAllocated = binsCount;
+	}
+	TileBinsCount = binsCount;
+	for( int i = 0; i < TileBinsCount; ++i ) {
+		TileBins[i].count = 0;
+	}
+
+	for( DWORD i = 0; i < SurfaceCount; ++i ) {
+		int yMin, yMax;
+		if( !GetPolyRows((__int16 *)SortBuffer[i]._0, &yMin, &yMax) ) return false;
+		CLAMPL(yMin, 0);
+		CLAMPG(yMax, height - 1);
+		for( int j = yMin / TILE_HEIGHT; j <= yMax / TILE_HEIGHT; ++j ) {
+			if( !TileBinAdd(&TileBins[j], i) ) return false;
+		}
+	}
+	return true;
+}
+
+static void DrawTiles(SWR_CONTEXT *ctx) {
+	LONG tile;
+	__int16 polyType, *bufPtr;
+
+	while( (tile = InterlockedIncrement(&TileNext) - 1) < TileBinsCount ) {
+		TILE_BIN *bin = &TileBins[tile];
+		ctx->clipY0 = tile * TILE_HEIGHT;
+		ctx->clipY1 = ctx->clipY0 + TILE_HEIGHT;
+		for( DWORD i = 0; i < bin->count; ++i ) {
+			bufPtr = (__int16 *)SortBuffer[bin->items[i]]._0;
+			polyType = *(bufPtr++);
+			TileDrawRoutines[polyType](bufPtr);
+		}
+	}
+}
+
+static DWORD WINAPI TileWorkerProc(LPVOID lpParameter) {
+	TILE_WORKER *worker = (TILE_WORKER *)lpParameter;
+
+	SetThreadContextSWR(&worker->ctx);
+	for(;;) {
+		WaitForSingleObject(worker->startEvent, INFINITE);
+		if( TileExit ) break;
+		// D3D sets single precision for the main thread, so the workers must
+		// use the same precision and rounding to draw the same spans
+		_control87(TileFpuControl, _MCW_PC|_MCW_RC);
+		DrawTiles(&worker->ctx);
+		SetEvent(worker->doneEvent);
+	}
+	return 0;
+}
+
+static int InitWorkers() {
+	SYSTEM_INFO sysInfo;
+
+	GetSystemInfo(&sysInfo);
+	int threadsCount = MIN((int)sysInfo.dwNumberOfProcessors, TILE_MAX_THREADS);
+
+	TileWorkersCount = 0;
+	TileExit = false;
+	for( int i = 0; i < threadsCount - 1; ++i ) {
+		TILE_WORKER *worker = &TileWorkers[TileWorkersCount];
+		memset(worker, 0, sizeof(TILE_WORKER));
+		worker->startEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		worker->doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if( worker->startEvent != NULL && worker->doneEvent != NULL ) {
+			worker->thread = CreateThread(NULL, 0, TileWorkerProc, worker, 0, NULL);
+		}
+		if( worker->thread == NULL ) {
+			if( worker->startEvent != NULL ) CloseHandle(worker->startEvent);
+			if( worker->doneEvent != NULL ) CloseHandle(worker->doneEvent);
+			break;
+		}
+		TileDoneEvents[TileWorkersCount++] = worker->doneEvent;
+	}
+	return TileWorkersCount;
+}
+
+/*
+ * Draws the sorted poly list by all CPU cores. The screen is split into
+ * horizontal tiles, every poly is binned to the tiles it overlaps, and
+ * the threads take the tiles one by one. The draw routines clip edges and
+ * spans to the thread tile, and the workers use the FPU precision and
+ * rounding of the main thread, so the result is the same as for the serial
+ * drawing.
+ * Returns false if the poly list must be drawn by the main thread only.
+ */
+bool SWR_PrintPolyListTiled(void (__cdecl **drawRoutines)(__int16 *)) {
+	if( SurfaceCount < TILE_MIN_POLYS ) return false;
+	if( TileWorkersCount < 0 ) InitWorkers();
+	if( TileWorkersCount == 0 ) return false;
+
+	if( !AllocContextSWR(&TileMainContext) ) return false;
+	for( int i = 0; i < TileWorkersCount; ++i ) {
+		if( !AllocContextSWR(&TileWorkers[i].ctx) ) return false;
+	}
+	if( !BinPolyList() ) return false;
+
+	TileDrawRoutines = drawRoutines;
+	TileNext = 0;
+	TileFpuControl = _control87(0, 0);
+	for( int i = 0; i < TileWorkersCount; ++i ) {
+		SetEvent(TileWorkers[i].startEvent);
+	}
+
+	SetThreadContextSWR(&TileMainContext);
+	DrawTiles(&TileMainContext);
+	SetThreadContextSWR(NULL);
+
+	WaitForMultipleObjects(TileWorkersCount, TileDoneEvents, TRUE, INFINITE);
+	return true;
+}
+
+void SWR_Cleanup() {
+	if( TileWorkersCount > 0 ) {
+		TileExit = true;
+		for( int i = 0; i < TileWorkersCount; ++i ) {
+			SetEvent(TileWorkers[i].startEvent);
+		}
+		for( int i = 0; i < TileWorkersCount; ++i ) {
+			WaitForSingleObject(TileWorkers[i].thread, INFINITE);
+			CloseHandle(TileWorkers[i].thread);
+			CloseHandle(TileWorkers[i].startEvent);
+			CloseHandle(TileWorkers[i].doneEvent);
+			FreeContextSWR(&TileWorkers[i].ctx);
+		}
+	}
+	TileWorkersCount = -1;
+	FreeContextSWR(&TileMainContext);
+
+	for( int i = 0; i < TileBinsAllocated; ++i ) {
+		free(TileBins[i].items);
+	}
+	free(TileBins);
+	TileBins = NULL;
+	TileBinsAllocated = 0;
+	TileBinsCount = 0;
+}
+#endif // FEATURE_RENDER_IMPROVED
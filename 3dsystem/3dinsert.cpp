@@ -21,6 +21,7 @@
 
 #include "global/precompiled.h"
 #include "3dsystem/3dinsert.h"
+#include "3dsystem/3d_arena.h"
 #include "specific/hwr.h"
 #include "global/vars.h"
 
@@ -167,6 +168,7 @@ bool InsertObjectEM(__int16 *ptrObj, int vtxCount, D3DCOLOR tint, PHD_UV *em_uv)
 void __cdecl InsertGourQuad(int x0, int y0, int x1, int y1, int z, D3DCOLOR color0, D3DCOLOR color1, D3DCOLOR color2, D3DCOLOR color3) {
 	double rhw, sz;
 
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
@@ -369,6 +371,12 @@ __int16 *__cdecl InsertObjectGT4(__int16 *ptrObj, int number, SORTTYPE sortType)
 	POINT_INFO points[4];
 
 	for( i = 0; i < number; ++i ) {
+#ifdef FEATURE_EXTENDED_LIMITS
+		if( !PolyListReserve(1, POLY_INFO_MAX) ) {
+			ptrObj += (number - i) * 5;
+			break;
+		}
+#endif // FEATURE_EXTENDED_LIMITS
 		vtx0 = &PhdVBuf[*ptrObj++];
 		vtx1 = &PhdVBuf[*ptrObj++];
 		vtx2 = &PhdVBuf[*ptrObj++];
@@ -601,6 +609,12 @@ __int16 *__cdecl InsertObjectGT3(__int16 *ptrObj, int number, SORTTYPE sortType)
 	POINT_INFO points[3];
 
 	for( i = 0; i < number; ++i ) {
+#ifdef FEATURE_EXTENDED_LIMITS
+		if( !PolyListReserve(1, POLY_INFO_MAX) ) {
+			ptrObj += (number - i) * 4;
+			break;
+		}
+#endif // FEATURE_EXTENDED_LIMITS
 		vtx0 = &PhdVBuf[*ptrObj++];
 		vtx1 = &PhdVBuf[*ptrObj++];
 		vtx2 = &PhdVBuf[*ptrObj++];
@@ -901,6 +915,12 @@ __int16 *__cdecl InsertObjectG4(__int16 *ptrObj, int number, SORTTYPE sortType)
 	POINT_INFO pts[4];
 
 	for( i = 0; i < number; ++i ) {
+#ifdef FEATURE_EXTENDED_LIMITS
+		if( !PolyListReserve(1, POLY_INFO_MAX) ) {
+			ptrObj += (number - i) * 5;
+			break;
+		}
+#endif // FEATURE_EXTENDED_LIMITS
 		vtx0 = &PhdVBuf[*ptrObj++];
 		vtx1 = &PhdVBuf[*ptrObj++];
 		vtx2 = &PhdVBuf[*ptrObj++];
@@ -1015,6 +1035,12 @@ __int16 *__cdecl InsertObjectG3(__int16 *ptrObj, int number, SORTTYPE sortType)
 	POINT_INFO pts[3];
 
 	for( i = 0; i < number; ++i ) {
+#ifdef FEATURE_EXTENDED_LIMITS
+		if( !PolyListReserve(1, POLY_INFO_MAX) ) {
+			ptrObj += (number - i) * 4;
+			break;
+		}
+#endif // FEATURE_EXTENDED_LIMITS
 		vtx0 = &PhdVBuf[*ptrObj++];
 		vtx1 = &PhdVBuf[*ptrObj++];
 		vtx2 = &PhdVBuf[*ptrObj++];
@@ -1221,6 +1247,7 @@ void __cdecl InsertTrans8(PHD_VBUF *vbuf, __int16 shade) {
 	int nVtx = 8;
 #endif // FEATURE_VIDEOFX_IMPROVED
 
+	POLYLIST_RESERVE;
 	for( i = 0; i < nVtx; ++i ) {
 		clipOR  |= LOBYTE(vbuf[i].clip);
 		clipAND &= LOBYTE(vbuf[i].clip);
@@ -1277,6 +1304,7 @@ void __cdecl InsertTrans8(PHD_VBUF *vbuf, __int16 shade) {
 }
 
 void __cdecl InsertTransQuad(int x, int y, int width, int height, int z) {
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(PhdNearZ + 8*z);
 	++Sort3dPtr;
@@ -1303,6 +1331,7 @@ void __cdecl InsertTransQuad(int x, int y, int width, int height, int z) {
 }
 
 void __cdecl InsertFlatRect(int x0, int y0, int x1, int y1, int z, BYTE colorIdx) {
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
@@ -1323,6 +1352,7 @@ void __cdecl InsertFlatRect(int x0, int y0, int x1, int y1, int z, BYTE colorIdx
 }
 
 void __cdecl InsertLine(int x0, int y0, int x1, int y1, int z, BYTE colorIdx) {
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
@@ -2517,6 +2547,7 @@ void __cdecl InsertFlatRect_Sorted(int x0, int y0, int x1, int y1, int z, BYTE c
 	double rhw, sz;
 	D3DCOLOR color;
 
+	POLYLIST_RESERVE;
 	if( x0 >= x1 || y0 >= y1 )
 		return;
 
@@ -2565,6 +2596,7 @@ void __cdecl InsertLine_Sorted(int x0, int y0, int x1, int y1, int z, BYTE color
 	double rhw, sz;
 	D3DCOLOR color;
 
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
@@ -2603,6 +2635,7 @@ void __cdecl InsertTrans8_Sorted(PHD_VBUF *vbuf, __int16 shade) {
 	int nVtx = 8;
 #endif // FEATURE_VIDEOFX_IMPROVED
 
+	POLYLIST_RESERVE;
 	for( i = 0; i < nVtx; ++i ) {
 		clipOR  |= LOBYTE(vbuf[i].clip);
 		clipAND &= LOBYTE(vbuf[i].clip);
@@ -2650,6 +2683,7 @@ void __cdecl InsertTransQuad_Sorted(int x, int y, int width, int height, int z)
 	float x0, y0, x1, y1;
 	double rhw, sz;
 
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
@@ -2692,6 +2726,7 @@ void __cdecl InsertSprite(int z, int x0, int y0, int x1, int y1, int spriteIdx,
 #else // FEATURE_VIDEOFX_IMPROVED
 void __cdecl InsertSprite(int z, int x0, int y0, int x1, int y1, int spriteIdx, __int16 shade) {
 #endif // FEATURE_VIDEOFX_IMPROVED
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = MAKE_ZSORT(z);
 	++Sort3dPtr;
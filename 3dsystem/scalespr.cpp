@@ -21,6 +21,7 @@
 
 #include "global/precompiled.h"
 #include "3dsystem/scalespr.h"
+#include "3dsystem/3d_out.h"
 #include "specific/output.h"
 #include "global/vars.h"
 
@@ -298,6 +299,19 @@ void __cdecl draw_scaled_spriteC(__int16 *ptrObj) {
 	isDepthQ = (GameVid_IsWindowedVga || depthQ != &DepthQTable[15]); // NOTE: index was 16 in the original code, this was wrong
 #endif // (DIRECT3D_VERSION >= 0x900)
 
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the rows of the thread clipping band are drawn
+	SWR_CONTEXT *ctx = GetContextSWR();
+	int row = PhdWinMinY + y1;
+	if( row < ctx->clipY0 ) {
+		vBase += vAdd * (ctx->clipY0 - row);
+		dst += pitch * (ctx->clipY0 - row);
+		height -= ctx->clipY0 - row;
+		row = ctx->clipY0;
+	}
+	CLAMPG(height, ctx->clipY1 - row);
+#endif // FEATURE_RENDER_IMPROVED
+
 	for( i = 0; i < height; ++i ) {
 		u = uBase;
 		src = srcBase + (vBase >> 16) * 256;
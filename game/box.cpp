@@ -27,6 +27,117 @@
 #include "game/missile.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/box_zones.h"
+#endif // FEATURE_ENGINE_IMPROVED
+
+#define NO_BOX			(-1)
+#define SEARCH_NUMBER	(0x7FFF)
+#define BLOCKED_SEARCH	(0x8000)
+
+static void ExpandBox(LOT_INFO *LOT, BOX_NODE *node, int boxNumber, int height) {
+	int change = (__int16)Boxes[boxNumber].height - height;
+	if( change > LOT->step || change < LOT->drop ) {
+		return;
+	}
+
+	BOX_NODE *expand = &LOT->node[boxNumber];
+	if( (node->search_number & SEARCH_NUMBER) < (expand->search_number & SEARCH_NUMBER) ) {
+		return;
+	}
+	if( CHK_ANY(node->search_number, BLOCKED_SEARCH) ) {
+		if( (node->search_number & SEARCH_NUMBER) == (expand->search_number & SEARCH_NUMBER) ) {
+			return;
+		}
+		expand->search_number = node->search_number;
+	} else {
+		if( (node->search_number & SEARCH_NUMBER) == (expand->search_number & SEARCH_NUMBER)
+			&& !CHK_ANY(expand->search_number, BLOCKED_SEARCH) )
+		{
+			return;
+		}
+		if( CHK_ANY(Boxes[boxNumber].overlapIndex, LOT->block_mask) ) {
+			expand->search_number = node->search_number | BLOCKED_SEARCH;
+		} else {
+			expand->search_number = node->search_number;
+			expand->exit_box = LOT->head;
+		}
+	}
+
+	if( expand->next_expansion == NO_BOX && boxNumber != LOT->tail ) {
+		LOT->node[LOT->tail].next_expansion = boxNumber;
+		LOT->tail = boxNumber;
+	}
+}
+
+BOOL __cdecl SearchLOT(LOT_INFO *LOT, int expansion) {
+	__int16 *zone;
+	__int16 searchZone = 0;
+
+	if( LOT->fly ) {
+		zone = FlyZones[FlipStatus];
+	} else {
+		zone = GroundZones[(LOT->step >> 8) * 2 - 2 + FlipStatus];
+	}
+	if( LOT->head != NO_BOX ) {
+		searchZone = zone[LOT->head];
+	}
+
+	for( int i = 0; i < expansion; ++i ) {
+		if( LOT->head == NO_BOX ) {
+			LOT->tail = NO_BOX;
+			return FALSE;
+		}
+
+		BOX_NODE *node = &LOT->node[LOT->head];
+		int height = (__int16)Boxes[LOT->head].height;
+#ifdef FEATURE_ENGINE_IMPROVED
+		// The zone table has the same zone overlaps only, in the same order
+		int count = 0;
+		UINT16 *overlaps = NULL;
+		if( zone[LOT->head] == searchZone ) {
+			overlaps = BZONE_GetOverlaps(zone, LOT->head, &count);
+		}
+		if( overlaps != NULL ) {
+			for( int j = 0; j < count; ++j ) {
+				ExpandBox(LOT, node, overlaps[j], height);
+			}
+		} else
+#endif // FEATURE_ENGINE_IMPROVED
+		{
+			int index = Boxes[LOT->head].overlapIndex & 0x3FFF;
+			UINT16 boxNumber;
+			do {
+				boxNumber = Overlaps[index++];
+				if( zone[boxNumber & 0x7FFF] == searchZone ) {
+					ExpandBox(LOT, node, boxNumber & 0x7FFF, height);
+				}
+			} while( !CHK_ANY(boxNumber, 0x8000) );
+		}
+
+		LOT->head = node->next_expansion;
+		node->next_expansion = NO_BOX;
+	}
+	return TRUE;
+}
+
+BOOL __cdecl UpdateLOT(LOT_INFO *LOT, int expansion) {
+	if( LOT->required_box != NO_BOX && LOT->required_box != LOT->target_box ) {
+		LOT->target_box = LOT->required_box;
+		BOX_NODE *expand = &LOT->node[LOT->target_box];
+		if( expand->next_expansion == NO_BOX && LOT->tail != LOT->target_box ) {
+			expand->next_expansion = LOT->head;
+			if( LOT->head == NO_BOX ) {
+				LOT->tail = LOT->target_box;
+			}
+			LOT->head = LOT->target_box;
+		}
+		expand->search_number = ++LOT->search_number;
+		expand->exit_box = NO_BOX;
+	}
+	return SearchLOT(LOT, expansion);
+}
+
 void __cdecl CreatureDie(__int16 itemID, BOOL explode) {
 	ITEM_INFO *item = &Items[itemID];
 	item->collidable = 0;
@@ -101,8 +212,8 @@ void Inject_Box() {
 //	INJECT(0x0040E190, InitialiseCreature);
 //	INJECT(0x0040E1C0, CreatureActive);
 //	INJECT(0x0040E210, CreatureAIInfo);
-//	INJECT(0x0040E470, SearchLOT);
-//	INJECT(0x0040E670, UpdateLOT);
+	INJECT(0x0040E470, SearchLOT);
+	INJECT(0x0040E670, UpdateLOT);
 //	INJECT(0x0040E6E0, TargetBox);
 //	INJECT(0x0040E780, StalkBox);
 //	INJECT(0x0040E880, EscapeBox);
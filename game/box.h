@@ -33,8 +33,9 @@
 
 #define CreatureAIInfo ((void(__cdecl*)(ITEM_INFO *, AI_INFO *)) 0x0040E210)
 
-//	0x0040E470:		SearchLOT
-//	0x0040E670:		UpdateLOT
+BOOL __cdecl SearchLOT(LOT_INFO *LOT, int expansion); // 0x0040E470
+BOOL __cdecl UpdateLOT(LOT_INFO *LOT, int expansion); // 0x0040E670
+
 //	0x0040E6E0:		TargetBox
 //	0x0040E780:		StalkBox
 //	0x0040E880:		EscapeBox
@@ -24,6 +24,11 @@
 #include "game/control.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/room_grid.h"
+#include "modding/static_index.h"
+#endif // FEATURE_ENGINE_IMPROVED
+
 int __cdecl CollideStaticObjects(COLL_INFO *coll, int x, int y, int z, __int16 roomID, int hite) {
 	int rxMin = x - coll->radius;
 	int rxMax = x + coll->radius;
@@ -38,7 +43,13 @@ int __cdecl CollideStaticObjects(COLL_INFO *coll, int x, int y, int z, __int16 r
 	// outer loop
 	for( int i = 0; i < DrawRoomsCount; ++i ) {
 		ROOM_INFO *room = &RoomInfo[DrawRoomsArray[i]];
+#ifdef FEATURE_ENGINE_IMPROVED
+		// The static index skips the meshes that surely do not collide
+		int first = SIDX_FirstCollision(DrawRoomsArray[i], rxMin, rxMax, ryMin, ryMax, rzMin, rzMax);
+		for( int j = first; j < room->numMeshes; ++j ) {
+#else // FEATURE_ENGINE_IMPROVED
 		for( int j = 0; j < room->numMeshes; ++j ) {
+#endif // FEATURE_ENGINE_IMPROVED
 			MESH_INFO *mesh = &room->mesh[j];
 			if( CHK_ANY(StaticObjects[mesh->staticNumber].flags, 1) ) {
 				continue;
@@ -169,6 +180,16 @@ int __cdecl CollideStaticObjects(COLL_INFO *coll, int x, int y, int z, __int16 r
 }
 
 void __cdecl GetNearByRooms(int x, int y, int z, int r, int h, __int16 roomID) {
+#ifdef FEATURE_ENGINE_IMPROVED
+	// The room grid finds the room if there is no valid seed room
+	if( roomID < 0 || roomID >= RoomCount ) {
+		roomID = RGRID_GetRoom(x, y, z);
+		if( roomID < 0 ) {
+			DrawRoomsCount = 0;
+			return;
+		}
+	}
+#endif // FEATURE_ENGINE_IMPROVED
 	DrawRoomsArray[0] = roomID;
 	DrawRoomsCount = 1;
 	GetNewRoom(x + r, y,     z + r, roomID);
@@ -182,7 +203,14 @@ void __cdecl GetNearByRooms(int x, int y, int z, int r, int h, __int16 roomID) {
 }
 
 void __cdecl GetNewRoom(int x, int y, int z, __int16 roomID) {
+#ifdef FEATURE_ENGINE_IMPROVED
+	// Most of the points are in the seed room sectors without doors
+	if( !RGRID_IsRoomSector(x, y, z, roomID) ) {
+		GetFloor(x, y, z, &roomID);
+	}
+#else // FEATURE_ENGINE_IMPROVED
 	GetFloor(x, y, z, &roomID);
+#endif // FEATURE_ENGINE_IMPROVED
 	for( int i = 0; i < DrawRoomsCount; ++i ) {
 		if( DrawRoomsArray[i] == roomID ) {
 			return;
@@ -24,6 +24,10 @@
 
 #include "global/types.h"
 
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/floor_cache.h"
+#endif // FEATURE_ENGINE_IMPROVED
+
 /*
  * Function list
  */
@@ -36,13 +40,23 @@ int __cdecl ControlPhase(int nTicks, BOOL demoMode);
 
 #define GetFloor ((FLOOR_INFO*(__cdecl*)(int, int, int, __int16*)) 0x00414B40)
 #define GetWaterHeight ((int(__cdecl*)(int, int, int, __int16)) 0x00414CE0)
+#ifdef FEATURE_ENGINE_IMPROVED
+// The floor cache calls the original function if required
+#define GetHeight FCACHE_GetHeight
+#else // FEATURE_ENGINE_IMPROVED
 #define GetHeight ((int(__cdecl*)(FLOOR_INFO*, int, int, int)) 0x00414E50)
+#endif // FEATURE_ENGINE_IMPROVED
 
 // 0x004150D0:		RefreshCamera
 
 #define TestTriggers ((void(__cdecl*)(__int16*, BOOL)) 0x004151C0)
 #define TriggerActive ((int(__cdecl*)(ITEM_INFO*)) 0x004158A0)
+#ifdef FEATURE_ENGINE_IMPROVED
+// The floor cache calls the original function if required
+#define GetCeiling FCACHE_GetCeiling
+#else // FEATURE_ENGINE_IMPROVED
 #define GetCeiling ((int(__cdecl*)(FLOOR_INFO*, int, int, int)) 0x00415900)
+#endif // FEATURE_ENGINE_IMPROVED
 
 // 0x00415B60:		GetDoor
 
@@ -29,12 +29,17 @@
 #include "global/vars.h"
 
 #ifdef FEATURE_EXTENDED_LIMITS
-LIGHT_INFO DynamicLights[64];
+LIGHT_INFO DynamicLights[256];
 int BoundRooms[1024];
 __int16 DrawRoomsArray[1024];
 STATIC_INFO StaticObjects[256];
 #endif // FEATURE_EXTENDED_LIMITS
 
+#ifdef FEATURE_RENDER_IMPROVED
+#include "modding/light_cluster.h"
+#include "modding/room_pvs.h"
+#endif // FEATURE_RENDER_IMPROVED
+
 #ifdef FEATURE_VIDEOFX_IMPROVED
 extern DWORD AlphaBlendMode;
 static int GoldenLaraAlpha = 0;
@@ -72,6 +77,9 @@ void __cdecl DrawRooms(__int16 currentRoom) {
 	}
 
 	UnderwaterCamera = room->flags & ROOM_UNDERWATER;
+#ifdef FEATURE_RENDER_IMPROVED
+	PVS_SetCameraRoom(currentRoom, MatrixW2V._03, MatrixW2V._13, MatrixW2V._23);
+#endif // FEATURE_RENDER_IMPROVED
 	GetRoomBounds();
 	MidSort = 0;
 
@@ -191,6 +199,10 @@ void __cdecl GetRoomBounds() {
 
 		for( int i = 0; i < room->doors->wCount; ++i ) {
 			DOOR_INFO *door = &room->doors->door[i];
+#ifdef FEATURE_RENDER_IMPROVED
+			// the room behind the door can't be seen from the camera room
+			if( !PVS_IsRoomVisible(door->room) ) continue;
+#endif // FEATURE_RENDER_IMPROVED
 			if( door->x * (room->x + door->vertex[0].x - MatrixW2V._03)
 				+ door->y * (room->y + door->vertex[0].y - MatrixW2V._13)
 				+ door->z * (room->z + door->vertex[0].z - MatrixW2V._23) < 0 )
@@ -1001,6 +1013,9 @@ void __cdecl AddDynamicLight(int x, int y, int z, int intensity, int falloff) {
 	DynamicLights[idx].z = z;
 	DynamicLights[idx].intensity1 = intensity;
 	DynamicLights[idx].fallOff1 = falloff;
+#ifdef FEATURE_RENDER_IMPROVED
+	LCLUST_Invalidate();
+#endif // FEATURE_RENDER_IMPROVED
 }
 
 /*
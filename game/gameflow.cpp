@@ -115,6 +115,30 @@ bool GF_IsFinalLevel(DWORD levelID) {
 	return GF_GetSequenceValue(levelID, GFE_GAMECOMPLETE, NULL, 0);
 }
 
+#ifdef FEATURE_LOADING_IMPROVED
+// NOTE: there is no such function in the original code
+int GF_GetNextLevel(DWORD levelID) {
+	__int16 startLevel = -1;
+	DWORD seqID = levelID;
+
+	if( GF_GameFlow.singleLevel >= 0 ) {
+		return -1;
+	}
+	// find the sequence that starts the level, it's usually the same index
+	for( DWORD i = 0; i < GF_GameFlow.num_Levels; ++i ) {
+		if( GF_GetSequenceValue(i, GFE_STARTLEVEL, &startLevel, -1) && startLevel == (__int16)levelID ) {
+			seqID = i;
+			break;
+		}
+	}
+	// the game is over after the final level, else GF_DoLevelSequence goes to the next sequence
+	if( GF_IsFinalLevel(seqID) || !GF_GetSequenceValue(seqID + 1, GFE_STARTLEVEL, &startLevel, -1) ) {
+		return -1;
+	}
+	return ( startLevel >= 0 && startLevel < GF_GameFlow.num_Levels ) ? startLevel : -1;
+}
+#endif // FEATURE_LOADING_IMPROVED
+
 BOOL __cdecl GF_LoadScriptFile(LPCTSTR fileName) {
 	GF_SunsetEnabled = 0;
 
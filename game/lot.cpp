@@ -23,7 +23,65 @@
 #include "game/lot.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/box_zones.h"
+#endif // FEATURE_ENGINE_IMPROVED
 
+void __cdecl CreateZone(ITEM_INFO *item) {
+	CREATURE_INFO *creature = (CREATURE_INFO *)item->data;
+	__int16 *zone, *flip;
+
+	if( creature->LOT.fly ) {
+		zone = FlyZones[0];
+		flip = FlyZones[1];
+	} else {
+		zone = GroundZones[(creature->LOT.step >> 8) * 2 - 2];
+		flip = GroundZones[(creature->LOT.step >> 8) * 2 - 1];
+	}
+
+	ROOM_INFO *room = &RoomInfo[item->roomNumber];
+	int xFloor = (item->pos.z - room->z) >> WALL_SHIFT;
+	int yFloor = (item->pos.x - room->x) >> WALL_SHIFT;
+	item->boxNumber = room->floor[xFloor + yFloor * room->xSize].box;
+
+	__int16 zoneNumber = zone[item->boxNumber];
+	__int16 flipNumber = flip[item->boxNumber];
+	BOX_NODE *node = creature->LOT.node;
+	creature->LOT.zone_count = 0;
+
+#ifdef FEATURE_ENGINE_IMPROVED
+	// The zone tables have the ascending box lists, so they are just merged
+	int zoneCount = 0, flipCount = 0;
+	UINT16 *zoneBoxes = BZONE_GetZoneBoxes(zone, item->boxNumber, &zoneCount);
+	UINT16 *flipBoxes = BZONE_GetZoneBoxes(flip, item->boxNumber, &flipCount);
+	if( zoneBoxes != NULL && flipBoxes != NULL ) {
+		int i = 0, j = 0;
+		while( i < zoneCount || j < flipCount ) {
+			UINT16 boxNumber;
+			if( j >= flipCount || (i < zoneCount && zoneBoxes[i] < flipBoxes[j]) ) {
+				boxNumber = zoneBoxes[i++];
+			} else if( i >= zoneCount || flipBoxes[j] < zoneBoxes[i] ) {
+				boxNumber = flipBoxes[j++];
+			} else {
+				boxNumber = zoneBoxes[i++];
+				++j;
+			}
+			node->box_number = boxNumber;
+			++node;
+			++creature->LOT.zone_count;
+		}
+		return;
+	}
+#endif // FEATURE_ENGINE_IMPROVED
+
+	for( DWORD i = 0; i < BoxesCount; ++i ) {
+		if( zone[i] == zoneNumber || flip[i] == flipNumber ) {
+			node->box_number = i;
+			++node;
+			++creature->LOT.zone_count;
+		}
+	}
+}
 
 /*
  * Inject function
@@ -33,6 +91,6 @@ void Inject_Lot() {
 //	INJECT(0x00432B70, DisableBaddieAI);
 //	INJECT(0x00432BC0, EnableBaddieAI);
 //	INJECT(0x00432D70, InitialiseSlot);
-//	INJECT(0x00432F80, CreateZone);
+	INJECT(0x00432F80, CreateZone);
 //	INJECT(0x00433040, ClearLOT);
 }
@@ -33,7 +33,8 @@
 #define EnableBaddieAI ((int(__cdecl*)(__int16, BOOL)) 0x00432BC0)
 
 //	0x00432D70:		InitialiseSlot
-//	0x00432F80:		CreateZone
+void __cdecl CreateZone(ITEM_INFO *item); // 0x00432F80
+
 //	0x00433040:		ClearLOT
 
 #endif // LOT_H_INCLUDED
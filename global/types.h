@@ -73,6 +73,10 @@ typedef struct {
 // Geometry values
 #define WALL_SHIFT			(10)
 #define NO_HEIGHT			(-0x7F00)
+#define NO_ROOM				(0xFF)
+#define FD_TYPE_MASK		(0x001F) // floor data command type
+#define FD_END_BIT			(0x8000) // floor data last command flag
+#define FD_TRIG_TYPE(a)		(((a)>>10)&0x0F) // trigger action type
 
 // AI values
 #define HP_DONT_TARGET		(0xC000)
@@ -132,6 +136,16 @@ typedef struct {
 #define SW_DETAIL_HIGH		(6 * 0x400 * W2V_SCALE)
 #define SW_DETAIL_ULTRA		(20* 0x400 * W2V_SCALE)
 
+#ifdef FEATURE_SIMD_RENDER
+// Vertex transform staging buffer size (must be a multiple of 8)
+#define VTX_STAGE_SIZE		(256)
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_EXTENDED_LIMITS
+// Max Info3d words per single poly: header and 40 clipped perspective vertices
+#define POLY_INFO_MAX		(3 + 40 * 9)
+#endif // FEATURE_EXTENDED_LIMITS
+
 // ClearBuffers flags
 #define CLRB_PrimaryBuffer			(0x0001)
 #define CLRB_BackBuffer				(0x0002)
@@ -288,7 +302,8 @@ typedef D3DTEXTUREHANDLE HWR_TEXHANDLE;
 #endif // (DIRECT3D_VERSION >= 0x900)
 
 #if (DIRECT3D_VERSION >= 0x900)
-#define VTXBUF_LEN (256)
+#define VTXBUF_LEN (1024)
+#define IDXBUF_LEN (VTXBUF_LEN*3)
 
 typedef struct {
 	DWORD width;
@@ -660,6 +675,30 @@ typedef enum {
 	EXTRA_FINALANIM,
 } LARA_EXTRA_STATES;
 
+typedef enum {
+	FT_FLOOR,
+	FT_DOOR,
+	FT_TILT,
+	FT_ROOF,
+	FT_TRIGGER,
+	FT_LAVA,
+	FT_CLIMB,
+} FLOOR_TYPES;
+
+typedef enum {
+	TO_OBJECT,
+	TO_CAMERA,
+	TO_SINK,
+	TO_FLIPMAP,
+	TO_FLIPON,
+	TO_FLIPOFF,
+	TO_TARGET,
+	TO_FINISH,
+	TO_CD,
+	TO_FLIPEFFECT,
+	TO_SECRET,
+} TRIGGER_TYPES;
+
 typedef enum {
 	VGA_NoVga,
 	VGA_256Color,
@@ -693,6 +732,24 @@ typedef enum {
 } JOY_INTERFACE;
 #endif // FEATURE_INPUT_IMPROVED
 
+#ifdef FEATURE_SIMD_RENDER
+typedef enum {
+	SIMD_None,
+	SIMD_SSE2,
+	SIMD_AVX2,
+} SIMD_LEVEL;
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_BENCHMARK
+typedef enum {
+	BENCH_Transform,
+	BENCH_Insert,
+	BENCH_Sort,
+	BENCH_Print,
+	BENCH_StageCount,
+} BENCH_STAGE;
+#endif // FEATURE_BENCHMARK
+
 typedef enum {
 #ifdef FEATURE_HUD_IMPROVED
 	CTRL_Joystick,
@@ -1174,6 +1231,17 @@ typedef struct SortItem_t {
 #endif // FEATURE_VIEW_IMPROVED
 } SORT_ITEM;
 
+#ifdef FEATURE_EXTENDED_LIMITS
+typedef struct FrameArena_t {
+	BYTE *base;
+	DWORD itemSize;
+	DWORD committed;
+	DWORD reserved;
+	DWORD highWater;
+	LPCTSTR name;
+} FRAME_ARENA;
+#endif // FEATURE_EXTENDED_LIMITS
+
 typedef struct RGB888_t {
 	BYTE red;
 	BYTE green;
@@ -1907,6 +1975,51 @@ typedef struct PhdVBuf_t {
 	__int16 v;
 } PHD_VBUF;
 
+#ifdef FEATURE_RENDER_IMPROVED
+typedef struct SwrContext_t {
+	void *xBuffer;
+	int height;
+	int xgenY0;
+	int xgenY1;
+	int clipY0;
+	int clipY1;
+} SWR_CONTEXT;
+#endif // FEATURE_RENDER_IMPROVED
+
+#ifdef FEATURE_SIMD_RENDER
+typedef struct VtxStage_t {
+	int xv[VTX_STAGE_SIZE];
+	int yv[VTX_STAGE_SIZE];
+	int zv[VTX_STAGE_SIZE];
+} VTX_STAGE;
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_RENDER_IMPROVED
+typedef struct FacePlane_t {
+	float x; // the unit normal looks to the visible side
+	float y;
+	float z;
+	float d;
+} FACE_PLANE;
+
+typedef struct CullCluster_t {
+	__int16 minX;
+	__int16 minY;
+	__int16 minZ;
+	__int16 maxX;
+	__int16 maxY;
+	__int16 maxZ;
+} CULL_CLUSTER;
+
+typedef struct CullMesh_t {
+	__int16 *mesh;
+	FACE_PLANE *planes;
+	CULL_CLUSTER *clusters;
+	BYTE *faceClusters;
+	int nClusters;
+} CULL_MESH;
+#endif // FEATURE_RENDER_IMPROVED
+
 typedef struct PointInfo_t {
 	float xv;
 	float yv;
@@ -151,6 +151,7 @@ extern __int16 InvOptionObjectsCount;
 #define IsShadeEffect				VAR_U_(0x004D6F68, bool)
 #define CineCurrentFrame			VAR_U_(0x004D7770, int)
 #define IsChunkyCamera				VAR_U_(0x004D777C, BOOL)
+#define HeightType					VAR_U_(0x004D7780, int)
 #define NoInputCounter				VAR_U_(0x004D7784, int)
 #define IsResetFlag					VAR_U_(0x004D7788, BOOL)
 #define FlipTimer					VAR_U_(0x004D778C, int)
@@ -562,13 +563,18 @@ extern PHD_SPRITE PhdSpriteInfo[2048];
 #else // FEATURE_EXTENDED_LIMITS
 #define PhdSpriteInfo				ARRAY_(0x0046E308, PHD_SPRITE, [512])
 #endif // FEATURE_EXTENDED_LIMITS
-#if defined(FEATURE_EXTENDED_LIMITS) || defined(FEATURE_VIEW_IMPROVED)
+#ifdef FEATURE_EXTENDED_LIMITS
+extern SORT_ITEM *SortBuffer;
+extern __int16 *Info3dBuffer;
+#else // FEATURE_EXTENDED_LIMITS
+#ifdef FEATURE_VIEW_IMPROVED
 extern SORT_ITEM SortBuffer[16000];
 extern __int16 Info3dBuffer[480000];
-#else // defined(FEATURE_EXTENDED_LIMITS) || defined(FEATURE_VIEW_IMPROVED)
+#else // FEATURE_VIEW_IMPROVED
 #define SortBuffer					ARRAY_(0x00470338, SORT_ITEM, [4000])
 #define Info3dBuffer				ARRAY_(0x00478060, __int16, [120000])
-#endif // defined(FEATURE_EXTENDED_LIMITS) || defined(FEATURE_VIEW_IMPROVED)
+#endif // FEATURE_VIEW_IMPROVED
+#endif // FEATURE_EXTENDED_LIMITS
 #define RandomTable					ARRAY_(0x004B2A28, int, [32])
 #ifdef FEATURE_EXTENDED_LIMITS
 extern PHD_TEXTURE PhdTextureInfo[0x2000];
@@ -614,7 +620,7 @@ extern BYTE LabTextureUVFlags[0x2000];
 #endif // FEATURE_EXTENDED_LIMITS
 #define LevelFileName				ARRAY_(0x004D9D88, char, [256])
 #ifdef FEATURE_EXTENDED_LIMITS
-extern D3DTLVERTEX HWR_VertexBuffer[0x8000];
+extern D3DTLVERTEX *HWR_VertexBuffer;
 extern HWR_TEXHANDLE HWR_PageHandles[128];
 extern int HWR_TexturePageIndexes[128];
 #else // FEATURE_EXTENDED_LIMITS
@@ -648,7 +654,7 @@ extern bool ConflictLayout[ARRAY_SIZE(Layout->key)];
 #define PickupInfos					ARRAY_(0x00521CA0, PICKUP_INFO, [12])
 #define Objects						ARRAY_(0x00522000, OBJECT_INFO, [265])
 #ifdef FEATURE_EXTENDED_LIMITS
-extern LIGHT_INFO DynamicLights[64];
+extern LIGHT_INFO DynamicLights[256];
 extern int BoundRooms[1024];
 extern __int16 DrawRoomsArray[1024];
 extern STATIC_INFO StaticObjects[256];
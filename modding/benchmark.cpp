@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/benchmark.h"
+#include "modding/file_utils.h"
+#include "specific/utils.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_BENCHMARK
+#define BENCH_PATH			".\\benchmark"
+#define BENCH_REPORT_PERIOD	(100) // frames per timing report line
+#define BENCH_DUMP_PERIOD	(100) // frames per PGM dump
+
+bool BenchmarkEnabled = false;
+
+static HANDLE TimingsFile = INVALID_HANDLE_VALUE;
+static HANDLE HashesFile = INVALID_HANDLE_VALUE;
+static LONGLONG StageStart[BENCH_StageCount];
+static LONGLONG StageTicks[BENCH_StageCount];
+static LONGLONG StageTotal[BENCH_StageCount];
+static double TickPeriod = 0.0;
+static DWORD FrameNumber = 0;
+static DWORD ReportFrames = 0;
+static DWORD ReportPolys = 0;
+static int BenchDemoCount = 0;
+
+static HANDLE CreateBenchFile(LPCSTR fileName) {
+	char path[MAX_PATH];
+	PathStringCombine(path, sizeof(path), BENCH_PATH, fileName);
+	CreateDirectories(path, true);
+	return CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void WriteBenchLine(HANDLE hFile, LPCSTR line) {
+	DWORD bytesWritten = 0;
+	if( hFile != INVALID_HANDLE_VALUE ) {
+		WriteFile(hFile, line, lstrlen(line), &bytesWritten, NULL);
+	}
+}
+
+// FNV-1a hash of the visible part of 8 bit surface
+static DWORD HashSurface(BYTE *surface, DWORD width, DWORD height, DWORD pitch) {
+	DWORD hash = 0x811C9DC5;
+	for( DWORD y = 0; y < height; ++y ) {
+		BYTE *src = surface + y * pitch;
+		for( DWORD x = 0; x < width; ++x ) {
+			hash = (hash ^ src[x]) * 0x01000193;
+		}
+	}
+	return hash;
+}
+
+// Writes 8 bit surface as binary PGM (palette indices as gray levels)
+static void DumpSurfacePGM(BYTE *surface, DWORD width, DWORD height, DWORD pitch) {
+	char fileName[32];
+	char header[64];
+	DWORD bytesWritten = 0;
+
+	snprintf(fileName, sizeof(fileName), "frame%06lu.pgm", FrameNumber);
+	HANDLE hFile = CreateBenchFile(fileName);
+	if( hFile == INVALID_HANDLE_VALUE ) return;
+
+	snprintf(header, sizeof(header), "P5\n%lu %lu\n255\n", width, height);
+	WriteFile(hFile, header, lstrlen(header), &bytesWritten, NULL);
+	for( DWORD y = 0; y < height; ++y ) {
+		WriteFile(hFile, surface + y * pitch, width, &bytesWritten, NULL);
+	}
+	CloseHandle(hFile);
+}
+
+/*
+ * Benchmark mode is activated by "-benchmark" command line option.
+ * Render stage timings are written into benchmark\timings.txt, and
+ * software renderer frame hashes are written into benchmark\hashes.txt.
+ * Every 100th software frame is dumped as PGM for golden image checks.
+ * The title is skipped, every level demo is played once, then the game
+ * exits. The demos advance by one frame of ticks per drawn frame, so the
+ * camera paths and the drawn frames are the same in every run.
+ */
+void BENCH_Init() {
+	LARGE_INTEGER frequency;
+
+	if( UT_FindArg("-benchmark") == NULL || !QueryPerformanceFrequency(&frequency) ) {
+		return;
+	}
+	TickPeriod = 1000.0 / (double)frequency.QuadPart; // milliseconds per tick
+	TimingsFile = CreateBenchFile("timings.txt");
+	HashesFile = CreateBenchFile("hashes.txt");
+	WriteBenchLine(TimingsFile, "frames\tpolys\ttransform\tinsert\tsort\tprint\t(average ms per frame)\r\n");
+	memset(StageTotal, 0, sizeof(StageTotal));
+	FrameNumber = 0;
+	ReportFrames = 0;
+	ReportPolys = 0;
+	BenchDemoCount = 0;
+	BenchmarkEnabled = true;
+}
+
+void BENCH_Cleanup() {
+	BenchmarkEnabled = false;
+	if( TimingsFile != INVALID_HANDLE_VALUE ) {
+		CloseHandle(TimingsFile);
+		TimingsFile = INVALID_HANDLE_VALUE;
+	}
+	if( HashesFile != INVALID_HANDLE_VALUE ) {
+		CloseHandle(HashesFile);
+		HashesFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+void BENCH_Start(BENCH_STAGE stage) {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	StageStart[stage] = counter.QuadPart;
+}
+
+void BENCH_Stop(BENCH_STAGE stage) {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	StageTicks[stage] += counter.QuadPart - StageStart[stage];
+}
+
+void BENCH_FrameSW(BYTE *surface, DWORD width, DWORD height, DWORD pitch) {
+	char line[64];
+
+	if( !BenchmarkEnabled || surface == NULL ) return;
+	snprintf(line, sizeof(line), "%lu\t%08lX\r\n", FrameNumber, HashSurface(surface, width, height, pitch));
+	WriteBenchLine(HashesFile, line);
+	if( (FrameNumber % BENCH_DUMP_PERIOD) == 0 ) {
+		DumpSurfacePGM(surface, width, height, pitch);
+	}
+}
+
+void BENCH_FrameEnd() {
+	char line[256];
+
+	if( !BenchmarkEnabled ) return;
+	for( int i = 0; i < BENCH_StageCount; ++i ) {
+		StageTotal[i] += StageTicks[i];
+		StageTicks[i] = 0;
+	}
+	ReportPolys += SurfaceCount;
+	++FrameNumber;
+	if( ++ReportFrames < BENCH_REPORT_PERIOD ) return;
+
+	int len = snprintf(line, sizeof(line), "%lu\t%lu", FrameNumber, ReportPolys / ReportFrames);
+	for( int i = 0; i < BENCH_StageCount; ++i ) {
+		double ms = (double)StageTotal[i] * TickPeriod / (double)ReportFrames;
+		len += snprintf(line + len, sizeof(line) - len, "\t%.3f", ms);
+		StageTotal[i] = 0;
+	}
+	snprintf(line + len, sizeof(line) - len, "\r\n");
+	WriteBenchLine(TimingsFile, line);
+	ReportFrames = 0;
+	ReportPolys = 0;
+}
+
+// Gets the gameflow option used instead of the title
+int BENCH_NextDemo() {
+	if( BenchDemoCount >= GF_GameFlow.num_Demos ) {
+		return GF_EXIT_GAME;
+	}
+	++BenchDemoCount;
+	return GF_START_DEMO;
+}
+
+bool BENCH_IsDemoPlaying() {
+	return ( BenchmarkEnabled && InvDemoMode );
+}
+#endif // FEATURE_BENCHMARK
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include "global/types.h"
+
+#ifdef FEATURE_BENCHMARK
+extern bool BenchmarkEnabled;
+
+#define BENCH_START(stage)	{if( BenchmarkEnabled ) BENCH_Start(stage);}
+#define BENCH_STOP(stage)	{if( BenchmarkEnabled ) BENCH_Stop(stage);}
+#else // FEATURE_BENCHMARK
+#define BENCH_START(stage)
+#define BENCH_STOP(stage)
+#endif // FEATURE_BENCHMARK
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_BENCHMARK
+void BENCH_Init();
+void BENCH_Cleanup();
+void BENCH_Start(BENCH_STAGE stage);
+void BENCH_Stop(BENCH_STAGE stage);
+void BENCH_FrameSW(BYTE *surface, DWORD width, DWORD height, DWORD pitch);
+void BENCH_FrameEnd();
+int BENCH_NextDemo();
+bool BENCH_IsDemoPlaying();
+#endif // FEATURE_BENCHMARK
+
+#endif // BENCHMARK_H_INCLUDED
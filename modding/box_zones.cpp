@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/box_zones.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_ENGINE_IMPROVED
+#define BZONE_SLOTS	(ARRAY_SIZE(GroundZones) + ARRAY_SIZE(FlyZones))
+
+/*
+ * The tables are built for every loaded zone array. The overlap lists keep
+ * only the boxes of the same zone, in the original order, so SearchLOT can
+ * skip the zone check. The zone lists keep the boxes of the same zone in
+ * ascending order, so CreateZone does not have to check every box. The
+ * zone arrays and overlaps never change in game, but the box blocking
+ * flags do, so they are not cached here.
+ */
+typedef struct BoxZoneTable_t {
+	__int16 *zone;
+	int *overlapStart; // BoxesCount+1 entries
+	UINT16 *overlaps;
+	int *zoneStart; // the zone list of the box
+	int *zoneCount;
+	UINT16 *zoneBoxes;
+} BOX_ZONE_TABLE;
+
+static BOX_ZONE_TABLE ZoneTables[BZONE_SLOTS];
+static int ZoneTablesCount = 0;
+
+static __int16 *SortZone = NULL;
+
+static int __cdecl CompareZoneBoxes(const void *a, const void *b) {
+	UINT16 boxA = *(UINT16 *)a;
+	UINT16 boxB = *(UINT16 *)b;
+	if( SortZone[boxA] != SortZone[boxB] ) {
+		return ( SortZone[boxA] < SortZone[boxB] ) ? -1 : 1;
+	}
+	return (int)boxA - (int)boxB;
+}
+
+static void FreeZoneTable(BOX_ZONE_TABLE *table) {
+	if( table->overlapStart != NULL ) free(table->overlapStart);
+	if( table->overlaps != NULL ) free(table->overlaps);
+	if( table->zoneStart != NULL ) free(table->zoneStart);
+	if( table->zoneCount != NULL ) free(table->zoneCount);
+	if( table->zoneBoxes != NULL ) free(table->zoneBoxes);
+	memset(table, 0, sizeof(BOX_ZONE_TABLE));
+}
+
+static bool BuildZoneTable(BOX_ZONE_TABLE *table, __int16 *zone) {
+	DWORD i;
+	int j, index, total = 0;
+	UINT16 boxNumber;
+
+	table->zone = zone;
+	table->overlapStart = (int *)malloc(sizeof(int) * (BoxesCount + 1));
+	table->zoneStart = (int *)malloc(sizeof(int) * BoxesCount);
+	table->zoneCount = (int *)malloc(sizeof(int) * BoxesCount);
+	table->zoneBoxes = (UINT16 *)malloc(sizeof(UINT16) * BoxesCount);
+	if( table->overlapStart == NULL || table->zoneStart == NULL ||
+		table->zoneCount == NULL || table->zoneBoxes == NULL )
+	{
+		return false;
+	}
+
+	// count the same zone overlaps, then fill them
+	for( i = 0; i < BoxesCount; ++i ) {
+		table->overlapStart[i] = total;
+		index = Boxes[i].overlapIndex & 0x3FFF;
+		do {
+			boxNumber = Overlaps[index++];
+			if( zone[boxNumber & 0x7FFF] == zone[i] ) ++total;
+		} while( !(boxNumber & 0x8000) );
+	}
+	table->overlapStart[BoxesCount] = total;
+	table->overlaps = (UINT16 *)malloc(sizeof(UINT16) * MAX(total, 1));
+	if( table->overlaps == NULL ) return false;
+	for( i = 0, j = 0; i < BoxesCount; ++i ) {
+		index = Boxes[i].overlapIndex & 0x3FFF;
+		do {
+			boxNumber = Overlaps[index++];
+			if( zone[boxNumber & 0x7FFF] == zone[i] ) {
+				table->overlaps[j++] = boxNumber & 0x7FFF;
+			}
+		} while( !(boxNumber & 0x8000) );
+	}
+
+	// the boxes are sorted by zones, then by numbers
+	for( i = 0; i < BoxesCount; ++i ) {
+		table->zoneBoxes[i] = i;
+	}
+	SortZone = zone;
+	qsort(table->zoneBoxes, BoxesCount, sizeof(UINT16), CompareZoneBoxes);
+	SortZone = NULL;
+	for( i = 0; i < BoxesCount; ) {
+		DWORD end = i;
+		while( end < BoxesCount && zone[table->zoneBoxes[end]] == zone[table->zoneBoxes[i]] ) ++end;
+		for( DWORD k = i; k < end; ++k ) {
+			table->zoneStart[table->zoneBoxes[k]] = i;
+			table->zoneCount[table->zoneBoxes[k]] = end - i;
+		}
+		i = end;
+	}
+	return true;
+}
+
+static BOX_ZONE_TABLE *FindZoneTable(__int16 *zone) {
+	for( int i = 0; i < ZoneTablesCount; ++i ) {
+		if( ZoneTables[i].zone == zone ) return &ZoneTables[i];
+	}
+	return NULL;
+}
+
+void BZONE_LevelInit() {
+	DWORD i;
+
+	BZONE_Cleanup();
+	if( Boxes == NULL || Overlaps == NULL || BoxesCount == 0 || BoxesCount > 0x8000 ) return;
+
+	for( i = 0; i < BZONE_SLOTS; ++i ) {
+		__int16 *zone = ( i < ARRAY_SIZE(GroundZones) ) ? GroundZones[i] : FlyZones[i - ARRAY_SIZE(GroundZones)];
+		if( zone == NULL || FindZoneTable(zone) != NULL ) continue;
+		if( !BuildZoneTable(&ZoneTables[ZoneTablesCount++], zone) ) {
+			BZONE_Cleanup();
+			return;
+		}
+	}
+}
+
+void BZONE_Cleanup() {
+	for( int i = 0; i < ZoneTablesCount; ++i ) {
+		FreeZoneTable(&ZoneTables[i]);
+	}
+	ZoneTablesCount = 0;
+}
+
+/*
+ * Returns the overlapping boxes of the same zone as the box has, or NULL if
+ * there is no table for the zone array
+ */
+UINT16 *BZONE_GetOverlaps(__int16 *zone, int boxNumber, int *count) {
+	BOX_ZONE_TABLE *table = FindZoneTable(zone);
+	if( table == NULL ) return NULL;
+	*count = table->overlapStart[boxNumber + 1] - table->overlapStart[boxNumber];
+	return &table->overlaps[table->overlapStart[boxNumber]];
+}
+
+/*
+ * Returns the ascending numbers of the boxes of the same zone as the box
+ * has, or NULL if there is no table for the zone array
+ */
+UINT16 *BZONE_GetZoneBoxes(__int16 *zone, int boxNumber, int *count) {
+	BOX_ZONE_TABLE *table = FindZoneTable(zone);
+	if( table == NULL ) return NULL;
+	*count = table->zoneCount[boxNumber];
+	return &table->zoneBoxes[table->zoneStart[boxNumber]];
+}
+#endif // FEATURE_ENGINE_IMPROVED
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/floor_cache.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_ENGINE_IMPROVED
+// The original functions are called for the sectors the cache cannot handle
+#define GetHeightOriginal ((int(__cdecl*)(FLOOR_INFO*, int, int, int)) 0x00414E50)
+#define GetCeilingOriginal ((int(__cdecl*)(FLOOR_INFO*, int, int, int)) 0x00415900)
+
+// The original functions switch the commands by the low byte of the word
+#define FC_TYPE_MASK	(0x00FF)
+
+#define FCF_TILT		(0x01) // the floor is tilted
+#define FCF_ROOF		(0x02) // the ceiling is tilted
+#define FCF_OBJECTS		(0x04) // the triggers have objects, they may change the heights
+#define FCF_UNKNOWN		(0x80) // the floor data is not recognized
+
+/*
+ * The floor data of every sector is decoded once at level load. The sector
+ * heights are changed by doors and moving blocks, so the base heights are
+ * always taken from the sector itself, and the record is used only while
+ * the sector floor data index is the same it was decoded for. The flipmap
+ * swaps the room data with its sector arrays, so the records are found by
+ * the sector address, which never changes.
+ */
+typedef struct FloorCacheSector_t {
+	__int16 index; // the floor data index the record is decoded for
+	__int16 trigger; // the trigger pointer offset GetHeight sets, or -1
+	char tiltX; // the floor slopes
+	char tiltZ;
+	BYTE flags;
+} FLOOR_CACHE_SECTOR;
+
+typedef struct FloorCacheRoom_t {
+	FLOOR_INFO *floor;
+	int count;
+	FLOOR_CACHE_SECTOR *sectors;
+} FLOOR_CACHE_ROOM;
+
+static FLOOR_CACHE_SECTOR *CacheSectors = NULL;
+static FLOOR_CACHE_ROOM *CacheRooms = NULL;
+static int CacheRoomsCount = 0;
+static FLOOR_CACHE_ROOM *LastRoom = NULL;
+
+static void DecodeSector(FLOOR_INFO *floor, FLOOR_CACHE_SECTOR *sector, DWORD floorDataCount) {
+	DWORD base = (UINT16)floor->index;
+	DWORD pos = base;
+	__int16 type, trigger;
+
+	sector->index = floor->index;
+	sector->trigger = -1;
+	sector->tiltX = sector->tiltZ = 0;
+	sector->flags = 0;
+	if( !floor->index ) return;
+
+	// The same walk as GetHeight does, the commands must end within the data
+	do {
+		if( pos >= floorDataCount ) goto UNKNOWN;
+		type = FloorData[pos++];
+		switch( type & FC_TYPE_MASK ) {
+			case FT_DOOR :
+				pos++;
+				break;
+			case FT_TILT :
+				// only one floor tilt per sector is cached
+				if( pos >= floorDataCount || CHK_ANY(sector->flags, FCF_TILT) ) goto UNKNOWN;
+				sector->tiltX = FloorData[pos] >> 8;
+				sector->tiltZ = (char)FloorData[pos];
+				sector->flags |= FCF_TILT;
+				pos++;
+				break;
+			case FT_ROOF :
+				pos++;
+				break;
+			case FT_TRIGGER :
+				if( sector->trigger < 0 ) sector->trigger = pos - 1 - base;
+				pos++;
+				do {
+					if( pos >= floorDataCount ) goto UNKNOWN;
+					trigger = FloorData[pos++];
+					if( FD_TRIG_TYPE(trigger) == TO_OBJECT ) {
+						sector->flags |= FCF_OBJECTS;
+					} else if( FD_TRIG_TYPE(trigger) == TO_CAMERA ) {
+						if( pos >= floorDataCount ) goto UNKNOWN;
+						trigger = FloorData[pos++];
+					}
+				} while( !(trigger & FD_END_BIT) );
+				break;
+			case FT_LAVA :
+				sector->trigger = pos - 1 - base;
+				break;
+			case FT_CLIMB :
+				if( sector->trigger < 0 ) sector->trigger = pos - 1 - base;
+				break;
+			default :
+				goto UNKNOWN;
+		}
+	} while( !(type & FD_END_BIT) );
+
+	// GetCeiling looks for the roof after the tilt even if the tilt is the last
+	pos = base;
+	type = FloorData[pos++];
+	if( (type & FC_TYPE_MASK) == FT_TILT ) {
+		pos++;
+		if( pos >= floorDataCount ) goto UNKNOWN;
+		type = FloorData[pos++];
+	}
+	if( (type & FC_TYPE_MASK) == FT_ROOF ) {
+		sector->flags |= FCF_ROOF;
+	}
+	return;
+
+UNKNOWN :
+	sector->flags |= FCF_UNKNOWN;
+}
+
+static int __cdecl CompareRooms(const void *a, const void *b) {
+	FLOOR_INFO *floorA = ((FLOOR_CACHE_ROOM *)a)->floor;
+	FLOOR_INFO *floorB = ((FLOOR_CACHE_ROOM *)b)->floor;
+	return ( floorA < floorB ) ? -1 : ( floorA > floorB ) ? 1 : 0;
+}
+
+static FLOOR_CACHE_SECTOR *FindSector(FLOOR_INFO *floor) {
+	FLOOR_CACHE_ROOM *room = LastRoom;
+
+	// the queries mostly come for the same room in a row
+	if( room == NULL || floor < room->floor || floor >= room->floor + room->count ) {
+		int lo = 0, hi = CacheRoomsCount - 1;
+		room = NULL;
+		while( lo <= hi ) {
+			int mid = (lo + hi) / 2;
+			if( floor < CacheRooms[mid].floor ) {
+				hi = mid - 1;
+			} else if( floor >= CacheRooms[mid].floor + CacheRooms[mid].count ) {
+				lo = mid + 1;
+			} else {
+				room = &CacheRooms[mid];
+				break;
+			}
+		}
+		if( room == NULL ) return NULL;
+		LastRoom = room;
+	}
+	return &room->sectors[floor - room->floor];
+}
+
+// Returns the cached sector if it's valid and has no unknown commands
+static FLOOR_CACHE_SECTOR *GetSector(FLOOR_INFO *floor) {
+	if( CacheSectors == NULL ) return NULL;
+	FLOOR_CACHE_SECTOR *sector = FindSector(floor);
+	if( sector == NULL || sector->index != floor->index || CHK_ANY(sector->flags, FCF_UNKNOWN) ) return NULL;
+	return sector;
+}
+
+void FCACHE_LevelInit(DWORD floorDataCount) {
+	int i, j, total = 0;
+
+	FCACHE_Cleanup();
+	if( RoomCount <= 0 || FloorData == NULL ) return;
+
+	for( i = 0; i < RoomCount; ++i ) {
+		total += RoomInfo[i].xSize * RoomInfo[i].ySize;
+	}
+	CacheRooms = (FLOOR_CACHE_ROOM *)malloc(sizeof(FLOOR_CACHE_ROOM) * RoomCount);
+	CacheSectors = (FLOOR_CACHE_SECTOR *)malloc(sizeof(FLOOR_CACHE_SECTOR) * MAX(total, 1));
+	if( CacheRooms == NULL || CacheSectors == NULL ) {
+		FCACHE_Cleanup();
+		return;
+	}
+
+	total = 0;
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		int count = room->xSize * room->ySize;
+		if( room->floor == NULL || count <= 0 ) continue;
+		FLOOR_CACHE_ROOM *cacheRoom = &CacheRooms[CacheRoomsCount++];
+		cacheRoom->floor = room->floor;
+		cacheRoom->count = count;
+		cacheRoom->sectors = &CacheSectors[total];
+		for( j = 0; j < count; ++j ) {
+			DecodeSector(&room->floor[j], &cacheRoom->sectors[j], floorDataCount);
+		}
+		total += count;
+	}
+	qsort(CacheRooms, CacheRoomsCount, sizeof(FLOOR_CACHE_ROOM), CompareRooms);
+}
+
+void FCACHE_Cleanup() {
+	if( CacheRooms != NULL ) {
+		free(CacheRooms);
+		CacheRooms = NULL;
+	}
+	if( CacheSectors != NULL ) {
+		free(CacheSectors);
+		CacheSectors = NULL;
+	}
+	CacheRoomsCount = 0;
+	LastRoom = NULL;
+}
+
+/*
+ * The same result as GetHeight has, but the floor data is not parsed. The
+ * sectors with object triggers are passed to the original function, since
+ * the objects (trapdoors, bridges) may change the height.
+ */
+int __cdecl FCACHE_GetHeight(FLOOR_INFO *floor, int x, int y, int z) {
+	FLOOR_CACHE_SECTOR *sector;
+	ROOM_INFO *room;
+	int height;
+
+	while( (BYTE)floor->pitRoom != NO_ROOM ) {
+		room = &RoomInfo[(BYTE)floor->pitRoom];
+		floor = &room->floor[((z - room->z) >> WALL_SHIFT) + ((x - room->x) >> WALL_SHIFT) * room->xSize];
+	}
+	if( floor->index ) {
+		sector = GetSector(floor);
+		if( sector == NULL || CHK_ANY(sector->flags, FCF_OBJECTS) ) {
+			return GetHeightOriginal(floor, x, y, z);
+		}
+	} else {
+		sector = NULL;
+	}
+
+	HeightType = 0;
+	height = floor->floor << 8;
+	if( GF_NoFloor && (__int16)GF_NoFloor == height ) {
+		height = 0x4000;
+	}
+	TriggerPtr = ( sector == NULL || sector->trigger < 0 ) ? NULL : &FloorData[(UINT16)floor->index + sector->trigger];
+	if( sector != NULL && CHK_ANY(sector->flags, FCF_TILT) ) {
+		int xOff = sector->tiltX;
+		int zOff = sector->tiltZ;
+		if( !IsChunkyCamera || (ABS(xOff) <= 2 && ABS(zOff) <= 2) ) {
+			HeightType = ( ABS(xOff) > 2 || ABS(zOff) > 2 ) ? 2 : 1;
+			if( xOff < 0 ) {
+				height -= (xOff * (z & 0x3FF)) >> 2;
+			} else {
+				height += (xOff * ((-1 - z) & 0x3FF)) >> 2;
+			}
+			if( zOff < 0 ) {
+				height -= (zOff * (x & 0x3FF)) >> 2;
+			} else {
+				height += (zOff * ((-1 - x) & 0x3FF)) >> 2;
+			}
+		}
+	}
+	return height;
+}
+
+/*
+ * The same result as GetCeiling has for the flat ceilings. The tilted
+ * ceilings and the sectors with object triggers are passed to the original
+ * function.
+ */
+int __cdecl FCACHE_GetCeiling(FLOOR_INFO *floor, int x, int y, int z) {
+	FLOOR_CACHE_SECTOR *sector;
+	FLOOR_INFO *skyFloor = floor;
+	FLOOR_INFO *pitFloor = floor;
+	ROOM_INFO *room;
+
+	while( (BYTE)skyFloor->skyRoom != NO_ROOM ) {
+		room = &RoomInfo[(BYTE)skyFloor->skyRoom];
+		skyFloor = &room->floor[((z - room->z) >> WALL_SHIFT) + ((x - room->x) >> WALL_SHIFT) * room->xSize];
+	}
+	if( skyFloor->index ) {
+		sector = GetSector(skyFloor);
+		if( sector == NULL || CHK_ANY(sector->flags, FCF_ROOF) ) {
+			return GetCeilingOriginal(floor, x, y, z);
+		}
+	}
+	// the objects are triggered from the lowest sector
+	while( (BYTE)pitFloor->pitRoom != NO_ROOM ) {
+		room = &RoomInfo[(BYTE)pitFloor->pitRoom];
+		pitFloor = &room->floor[((z - room->z) >> WALL_SHIFT) + ((x - room->x) >> WALL_SHIFT) * room->xSize];
+	}
+	if( pitFloor->index ) {
+		sector = GetSector(pitFloor);
+		if( sector == NULL || CHK_ANY(sector->flags, FCF_OBJECTS) ) {
+			return GetCeilingOriginal(floor, x, y, z);
+		}
+	}
+	return skyFloor->ceiling << 8;
+}
+#endif // FEATURE_ENGINE_IMPROVED
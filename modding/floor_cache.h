@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLOOR_CACHE_H_INCLUDED
+#define FLOOR_CACHE_H_INCLUDED
+
+#include "global/types.h"
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_ENGINE_IMPROVED
+void FCACHE_LevelInit(DWORD floorDataCount);
+void FCACHE_Cleanup();
+int __cdecl FCACHE_GetHeight(FLOOR_INFO *floor, int x, int y, int z);
+int __cdecl FCACHE_GetCeiling(FLOOR_INFO *floor, int x, int y, int z);
+#endif // FEATURE_ENGINE_IMPROVED
+
+#endif // FLOOR_CACHE_H_INCLUDED
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/hwr_record.h"
+#include "modding/file_utils.h"
+#include "specific/utils.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_BENCHMARK
+#define HREC_REPORT_PATH	".\\benchmark\\hwr_report.txt"
+#define HREC_LOG_PATH		".\\benchmark\\hwr_frames.bin"
+
+bool HwrNullDraw = false;
+
+/*
+ * HWR recording mode is activated by "-hwrecord" command line option.
+ * All draw calls and render state changes made by the hardware renderer
+ * are recorded per frame into benchmark\hwr_report.txt and
+ * benchmark\hwr_frames.bin (see HREC_Open).
+ * With "-hwrnull" option the draw calls are recorded but not submitted
+ * to the device, so the CPU submission cost can be measured alone.
+ */
+void HREC_Init() {
+	HwrNullDraw = ( UT_FindArg("-hwrnull") != NULL );
+	if( UT_FindArg("-hwrecord") == NULL && !HwrNullDraw ) {
+		return;
+	}
+	CreateDirectories(HREC_REPORT_PATH, true);
+	HREC_Open(HREC_REPORT_PATH, HREC_LOG_PATH);
+}
+
+void HREC_Cleanup() {
+	HREC_Close();
+	HwrNullDraw = false;
+}
+#endif // FEATURE_BENCHMARK
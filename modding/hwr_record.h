@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HWR_RECORD_H_INCLUDED
+#define HWR_RECORD_H_INCLUDED
+
+#include "global/types.h"
+#include "modding/hwr_record_core.h"
+
+#ifdef FEATURE_BENCHMARK
+extern bool HwrNullDraw;
+
+#define HREC_RECORD(type, arg, count, value)	do {if( HwrRecordEnabled ) HREC_Event(type, arg, count, value);} while(0)
+#else // FEATURE_BENCHMARK
+#define HREC_RECORD(type, arg, count, value)
+#endif // FEATURE_BENCHMARK
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_BENCHMARK
+void HREC_Init();
+void HREC_Cleanup();
+#endif // FEATURE_BENCHMARK
+
+#endif // HWR_RECORD_H_INCLUDED
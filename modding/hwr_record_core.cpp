@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// NOTE: unlike the other files, this one does not include global/precompiled.h.
+// The recorder core uses the C standard library only, so it does not depend
+// on Win32 or D3D and can be compiled and checked apart from the game.
+#include <stdio.h>
+#include <string.h>
+#include "modding/hwr_record_core.h"
+
+#ifdef FEATURE_BENCHMARK
+#define HREC_EVENTS_LEN		(0x10000) // events per frame kept in the log
+
+bool HwrRecordEnabled = false;
+
+static FILE *ReportFile = NULL;
+static FILE *LogFile = NULL;
+static HREC_EVENT Events[HREC_EVENTS_LEN];
+static uint32_t EventCount = 0;
+static uint32_t FrameNumber = 0;
+
+static struct {
+	uint32_t scenes;
+	uint32_t draws;
+	uint32_t indexedDraws;
+	uint32_t vertices;
+	uint32_t indices;
+	uint32_t textures;
+	uint32_t states;
+	uint32_t blends;
+	uint32_t events;
+} Frame, Total;
+
+static void AddFrameStats() {
+	Total.scenes += Frame.scenes;
+	Total.draws += Frame.draws;
+	Total.indexedDraws += Frame.indexedDraws;
+	Total.vertices += Frame.vertices;
+	Total.indices += Frame.indices;
+	Total.textures += Frame.textures;
+	Total.states += Frame.states;
+	Total.blends += Frame.blends;
+	Total.events += Frame.events;
+}
+
+static void WriteReportLine(const char *name, uint32_t frames) {
+	if( ReportFile == NULL || frames == 0 ) return;
+	fprintf(ReportFile, "%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\r\n", name,
+		(unsigned long)(Frame.scenes / frames),
+		(unsigned long)((Frame.draws + Frame.indexedDraws) / frames),
+		(unsigned long)(Frame.indexedDraws / frames),
+		(unsigned long)(Frame.vertices / frames),
+		(unsigned long)(Frame.indices / frames),
+		(unsigned long)(Frame.textures / frames),
+		(unsigned long)(Frame.states / frames),
+		(unsigned long)(Frame.blends / frames));
+}
+
+/*
+ * Starts the recording. The draw call, state change and vertex counts are
+ * written into the report file per frame, and the recorded events are
+ * written into the log file as the frame number, the event count and
+ * the array of 8 byte HREC_EVENT records per frame.
+ */
+bool HREC_Open(const char *reportPath, const char *logPath) {
+	HREC_Close();
+	ReportFile = fopen(reportPath, "wb");
+	LogFile = fopen(logPath, "wb");
+	if( ReportFile != NULL ) {
+		fprintf(ReportFile, "frame\tscenes\tdraws\tindexed\tvertices\tindices\ttextures\tstates\tblends\r\n");
+	}
+	memset(&Frame, 0, sizeof(Frame));
+	memset(&Total, 0, sizeof(Total));
+	EventCount = 0;
+	FrameNumber = 0;
+	HwrRecordEnabled = true;
+	return ( ReportFile != NULL || LogFile != NULL );
+}
+
+void HREC_Close() {
+	if( HwrRecordEnabled ) {
+		// the last line is the average per frame
+		Frame = Total;
+		WriteReportLine("average", FrameNumber);
+	}
+	HwrRecordEnabled = false;
+	if( ReportFile != NULL ) {
+		fclose(ReportFile);
+		ReportFile = NULL;
+	}
+	if( LogFile != NULL ) {
+		fclose(LogFile);
+		LogFile = NULL;
+	}
+}
+
+void HREC_Event(HREC_EVENT_TYPE type, uint32_t arg, uint32_t count, uint32_t value) {
+	switch( type ) {
+		case HREC_BeginScene :
+			++Frame.scenes;
+			break;
+		case HREC_Draw :
+			++Frame.draws;
+			Frame.vertices += count;
+			break;
+		case HREC_DrawIndexed :
+			++Frame.indexedDraws;
+			Frame.vertices += count;
+			Frame.indices += value;
+			break;
+		case HREC_Texture :
+			++Frame.textures;
+			break;
+		case HREC_Blend :
+			++Frame.blends;
+			break;
+		default :
+			++Frame.states;
+			break;
+	}
+	++Frame.events;
+	if( EventCount < HREC_EVENTS_LEN ) {
+		HREC_EVENT *event = &Events[EventCount++];
+		event->type = type;
+		event->arg = arg;
+		event->count = count;
+		event->value = value;
+	}
+}
+
+void HREC_FrameEnd() {
+	char name[16];
+
+	if( !HwrRecordEnabled || Frame.events == 0 ) return;
+	snprintf(name, sizeof(name), "%lu", (unsigned long)FrameNumber);
+	WriteReportLine(name, 1);
+	if( LogFile != NULL ) {
+		fwrite(&FrameNumber, sizeof(uint32_t), 1, LogFile);
+		fwrite(&EventCount, sizeof(uint32_t), 1, LogFile);
+		fwrite(Events, sizeof(HREC_EVENT), EventCount, LogFile);
+	}
+	AddFrameStats();
+	memset(&Frame, 0, sizeof(Frame));
+	EventCount = 0;
+	++FrameNumber;
+}
+#endif // FEATURE_BENCHMARK
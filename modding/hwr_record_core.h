@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HWR_RECORD_CORE_H_INCLUDED
+#define HWR_RECORD_CORE_H_INCLUDED
+
+#include <stdint.h>
+
+#ifdef FEATURE_BENCHMARK
+typedef enum {
+	HREC_BeginScene,
+	HREC_Draw,
+	HREC_DrawIndexed,
+	HREC_Texture,
+	HREC_ColorKey,
+	HREC_ZWrite,
+	HREC_ZEnable,
+	HREC_AlphaBlend,
+	HREC_Blend,
+} HREC_EVENT_TYPE;
+
+typedef struct HwrRecordEvent_t {
+	uint8_t type;
+	uint8_t arg; // primitive type or state value
+	uint16_t count; // vertex count
+	uint32_t value; // index count or texture page
+} HREC_EVENT;
+
+extern bool HwrRecordEnabled;
+#endif // FEATURE_BENCHMARK
+
+/*
+ * Function list
+ */
+#ifdef FEATURE_BENCHMARK
+bool HREC_Open(const char *reportPath, const char *logPath);
+void HREC_Close();
+void HREC_Event(HREC_EVENT_TYPE type, uint32_t arg, uint32_t count, uint32_t value);
+void HREC_FrameEnd();
+#endif // FEATURE_BENCHMARK
+
+#endif // HWR_RECORD_CORE_H_INCLUDED
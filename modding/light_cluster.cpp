@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/light_cluster.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_RENDER_IMPROVED
+/*
+ * The dynamic lights are clustered by rooms. A room list keeps the lights
+ * whose radius box overlaps the room footprint, in the light order, so the
+ * items, the static meshes and the room vertices of the room check only
+ * these lights. The lists are made when a room is lit for the first time
+ * after the lights are changed, so only the drawn rooms are clustered.
+ */
+typedef struct LightCluster_t {
+	FLOOR_INFO *roomFloor; // the room data identity
+	DWORD stamp; // the light set the list is made for
+	int count;
+	UINT16 *lights;
+} LIGHT_CLUSTER;
+
+static LIGHT_CLUSTER *Clusters = NULL;
+static UINT16 *ClusterLights = NULL;
+static int ClustersCount = 0;
+static DWORD LightsStamp = 1;
+
+void LCLUST_LevelInit() {
+	int i, maxLights = ARRAY_SIZE(DynamicLights);
+
+	LCLUST_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	Clusters = (LIGHT_CLUSTER *)calloc(RoomCount, sizeof(LIGHT_CLUSTER));
+	ClusterLights = (UINT16 *)malloc(sizeof(UINT16) * maxLights * RoomCount);
+	if( Clusters == NULL || ClusterLights == NULL ) {
+		LCLUST_Cleanup();
+		return;
+	}
+	ClustersCount = RoomCount;
+	for( i = 0; i < RoomCount; ++i ) {
+		Clusters[i].lights = &ClusterLights[maxLights * i];
+	}
+}
+
+void LCLUST_Cleanup() {
+	if( Clusters != NULL ) {
+		free(Clusters);
+		Clusters = NULL;
+	}
+	if( ClusterLights != NULL ) {
+		free(ClusterLights);
+		ClusterLights = NULL;
+	}
+	ClustersCount = 0;
+}
+
+// Must be called when a dynamic light is added
+void LCLUST_Invalidate() {
+	// zero is never taken, so the new clusters are always rebuilt
+	if( ++LightsStamp == 0 ) ++LightsStamp;
+}
+
+/*
+ * Returns the dynamic lights that overlap the room footprint. The lights
+ * are not tested by height. NULL means that all lights must be checked.
+ */
+UINT16 *LCLUST_GetRoomLights(int roomNumber, int *count) {
+	if( Clusters == NULL || roomNumber < 0 || roomNumber >= ClustersCount ) return NULL;
+
+	ROOM_INFO *room = &RoomInfo[roomNumber];
+	LIGHT_CLUSTER *cluster = &Clusters[roomNumber];
+	// the light count is reset without a call, so it's checked too
+	if( cluster->stamp != LightsStamp || cluster->roomFloor != room->floor ||
+		(cluster->count > 0 && cluster->lights[cluster->count - 1] >= DynamicLightCount) )
+	{
+		int xMax = room->ySize << WALL_SHIFT;
+		int zMax = room->xSize << WALL_SHIFT;
+		cluster->roomFloor = room->floor;
+		cluster->stamp = LightsStamp;
+		cluster->count = 0;
+		for( DWORD i = 0; i < DynamicLightCount; ++i ) {
+			int xPos = DynamicLights[i].x - room->x;
+			int zPos = DynamicLights[i].z - room->z;
+			int radius = 1 << DynamicLights[i].fallOff1;
+			if( xPos + radius >= 0 && zPos + radius >= 0 && xPos - radius <= xMax && zPos - radius <= zMax ) {
+				cluster->lights[cluster->count++] = i;
+			}
+		}
+	}
+	*count = cluster->count;
+	return cluster->lights;
+}
+
+/*
+ * Returns the dynamic lights that may light the point of the room. NULL
+ * means that all lights must be checked.
+ */
+UINT16 *LCLUST_GetLights(int roomNumber, int x, int z, int *count) {
+	if( Clusters == NULL || roomNumber < 0 || roomNumber >= ClustersCount ) return NULL;
+
+	ROOM_INFO *room = &RoomInfo[roomNumber];
+	// the point out of the room footprint may be lit by the lights out of the list
+	if( x < room->x || z < room->z ||
+		x > room->x + (room->ySize << WALL_SHIFT) || z > room->z + (room->xSize << WALL_SHIFT) )
+	{
+		return NULL;
+	}
+	return LCLUST_GetRoomLights(roomNumber, count);
+}
+#endif // FEATURE_RENDER_IMPROVED
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/light_probe.h"
+#include "global/vars.h"
+#include <limits.h>
+
+#ifdef FEATURE_RENDER_IMPROVED
+/*
+ * The static room lights are baked into a probe grid at level load. The
+ * probe cells are the room sectors split into the height layers of the same
+ * size, and every cell keeps the lights that may be the brightest somewhere
+ * in it. The light shade changes only with the distance, so a light is
+ * dropped if its shade at the nearest point of the cell is below the shade
+ * another light has at its farthest point. S_CalculateLight checks the kept
+ * lights in the original order, so the result is exactly the same.
+ */
+typedef struct LightProbeRoom_t {
+	FLOOR_INFO *roomFloor; // the room data identity
+	__int16 pair; // the flipmap pair slot
+	int layers; // the height layers count, 0 if the room has no probes
+	int *cellStart; // the light list offsets per cell
+} LIGHT_PROBE_ROOM;
+
+static LIGHT_PROBE_ROOM *ProbeRooms = NULL;
+static int ProbeRoomsCount = 0;
+static int *ProbeCells = NULL;
+static UINT16 *ProbeLights = NULL;
+static int ProbeLightsCount = 0;
+static int ProbeLightsSize = 0;
+
+static bool AddProbeLight(UINT16 lightIndex) {
+	if( ProbeLightsCount >= ProbeLightsSize ) {
+		int size = MAX(ProbeLightsSize * 2, 1024);
+		UINT16 *lights = (UINT16 *)realloc(ProbeLights, sizeof(UINT16) * size);
+		if( lights == NULL ) return false;
+		ProbeLights = lights;
+		ProbeLightsSize = size;
+	}
+	ProbeLights[ProbeLightsCount++] = lightIndex;
+	return true;
+}
+
+// The light is baked only if S_CalculateLight has no integer overflow for it
+static bool IsBakeable(int fallOff, __int16 intensity) {
+	if( fallOff <= 0 || fallOff > 46340 ) return false;
+	int falloff = SQR(fallOff) >> 12;
+	__int64 product = (__int64)falloff * intensity;
+	return ( falloff > 0 && product >= INT_MIN && product <= INT_MAX );
+}
+
+static void GetAxisRange(int cellMin, int cellMax, int light, __int64 *minSqr, __int64 *maxSqr) {
+	__int64 lo = (__int64)cellMin - light;
+	__int64 hi = (__int64)cellMax - light;
+	if( lo > 0 ) {
+		*minSqr += lo * lo;
+	} else if( hi < 0 ) {
+		*minSqr += hi * hi;
+	}
+	*maxSqr += MAX(lo * lo, hi * hi);
+}
+
+// Gets the distance range the way S_CalculateLight measures it
+static bool GetDistanceRange(LIGHT_INFO *light, int x, int y, int z, int *minDist, int *maxDist) {
+	__int64 minSqr = 0, maxSqr = 0;
+	int size = (1 << WALL_SHIFT) - 1;
+	GetAxisRange(x, x + size, light->x, &minSqr, &maxSqr);
+	GetAxisRange(y, y + size, light->y, &minSqr, &maxSqr);
+	GetAxisRange(z, z + size, light->z, &minSqr, &maxSqr);
+	if( maxSqr > INT_MAX ) return false;
+	*minDist = (int)minSqr >> 12;
+	*maxDist = (int)maxSqr >> 12;
+	return true;
+}
+
+static void GetShadeRange(int fallOff, __int16 intensity, int minDist, int maxDist, int *minShade, int *maxShade) {
+	int falloff = SQR(fallOff) >> 12;
+	int nearShade = falloff * intensity / (falloff + minDist);
+	int farShade = falloff * intensity / (falloff + maxDist);
+	*minShade = MIN(*minShade, MIN(nearShade, farShade));
+	*maxShade = MAX(*maxShade, MAX(nearShade, farShade));
+}
+
+static bool BakeRoom(ROOM_INFO *room, LIGHT_PROBE_ROOM *probe, int *minShade, int *maxShade) {
+	int cx, cy, cz, i, cell = 0;
+	bool isFlickering = ( room->lightMode != 0 );
+
+	for( cx = 0; cx < room->ySize; ++cx ) {
+		for( cz = 0; cz < room->xSize; ++cz ) {
+			for( cy = 0; cy < probe->layers; ++cy ) {
+				int x = room->x + (cx << WALL_SHIFT);
+				int y = room->maxCeiling + (cy << WALL_SHIFT);
+				int z = room->z + (cz << WALL_SHIFT);
+				int best = 0;
+
+				for( i = 0; i < room->numLights; ++i ) {
+					LIGHT_INFO *light = &room->light[i];
+					int minDist, maxDist;
+					minShade[i] = INT_MIN;
+					maxShade[i] = INT_MAX;
+					if( !IsBakeable(light->fallOff1, light->intensity1) ||
+						(isFlickering && !IsBakeable(light->fallOff2, light->intensity2)) ||
+						!GetDistanceRange(light, x, y, z, &minDist, &maxDist) )
+					{
+						continue;
+					}
+					// the flickering shade is always between the two light shades
+					minShade[i] = INT_MAX;
+					maxShade[i] = INT_MIN;
+					GetShadeRange(light->fallOff1, light->intensity1, minDist, maxDist, &minShade[i], &maxShade[i]);
+					if( isFlickering ) {
+						GetShadeRange(light->fallOff2, light->intensity2, minDist, maxDist, &minShade[i], &maxShade[i]);
+					}
+					best = MAX(best, minShade[i]);
+				}
+
+				probe->cellStart[cell] = ProbeLightsCount;
+				for( i = 0; i < room->numLights; ++i ) {
+					// the light must be brighter than zero to be taken at all
+					if( maxShade[i] <= 0 || maxShade[i] < best ) continue;
+					if( !AddProbeLight(i) ) return false;
+				}
+				++cell;
+			}
+		}
+	}
+	probe->cellStart[cell] = ProbeLightsCount;
+	return true;
+}
+
+void LPROBE_LevelInit() {
+	int i, total = 0, maxLights = 0;
+	int *minShade = NULL;
+	int *maxShade = NULL;
+
+	LPROBE_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	ProbeRooms = (LIGHT_PROBE_ROOM *)calloc(RoomCount, sizeof(LIGHT_PROBE_ROOM));
+	if( ProbeRooms == NULL ) return;
+	ProbeRoomsCount = RoomCount;
+
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		LIGHT_PROBE_ROOM *probe = &ProbeRooms[i];
+		probe->roomFloor = room->floor;
+		probe->pair = -1;
+		// a single light is cheaper to check than to look up
+		if( room->floor == NULL || room->light == NULL || room->numLights < 2 || room->xSize <= 0 ||
+			room->ySize <= 0 || room->minFloor < room->maxCeiling )
+		{
+			continue;
+		}
+		probe->layers = ((room->minFloor - room->maxCeiling) >> WALL_SHIFT) + 1;
+		total += room->xSize * room->ySize * probe->layers + 1;
+		maxLights = MAX(maxLights, room->numLights);
+	}
+	// the flipmap pair is the same in both flip states
+	for( i = 0; i < RoomCount; ++i ) {
+		__int16 flipped = RoomInfo[i].flippedRoom;
+		if( flipped >= 0 && flipped < RoomCount ) {
+			ProbeRooms[i].pair = flipped;
+			ProbeRooms[flipped].pair = i;
+		}
+	}
+	if( total == 0 ) return;
+
+	ProbeCells = (int *)malloc(sizeof(int) * total);
+	minShade = (int *)malloc(sizeof(int) * maxLights);
+	maxShade = (int *)malloc(sizeof(int) * maxLights);
+	if( ProbeCells == NULL || minShade == NULL || maxShade == NULL ) {
+		LPROBE_Cleanup();
+		goto CLEANUP;
+	}
+
+	total = 0;
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		LIGHT_PROBE_ROOM *probe = &ProbeRooms[i];
+		if( probe->layers == 0 ) continue;
+		probe->cellStart = &ProbeCells[total];
+		total += room->xSize * room->ySize * probe->layers + 1;
+		if( !BakeRoom(room, probe, minShade, maxShade) ) {
+			LPROBE_Cleanup();
+			goto CLEANUP;
+		}
+	}
+
+CLEANUP :
+	if( minShade != NULL ) free(minShade);
+	if( maxShade != NULL ) free(maxShade);
+}
+
+void LPROBE_Cleanup() {
+	if( ProbeRooms != NULL ) {
+		free(ProbeRooms);
+		ProbeRooms = NULL;
+	}
+	if( ProbeCells != NULL ) {
+		free(ProbeCells);
+		ProbeCells = NULL;
+	}
+	if( ProbeLights != NULL ) {
+		free(ProbeLights);
+		ProbeLights = NULL;
+	}
+	ProbeRoomsCount = 0;
+	ProbeLightsCount = 0;
+	ProbeLightsSize = 0;
+}
+
+/*
+ * Returns the static lights that may be the brightest at the point, in the
+ * room light order. NULL means that all room lights must be checked.
+ */
+UINT16 *LPROBE_GetLights(int roomNumber, int x, int y, int z, int *count) {
+	ROOM_INFO *room;
+	LIGHT_PROBE_ROOM *probe;
+	int cx, cy, cz, cell;
+
+	if( ProbeLights == NULL || roomNumber < 0 || roomNumber >= ProbeRoomsCount ) return NULL;
+	room = &RoomInfo[roomNumber];
+	probe = &ProbeRooms[roomNumber];
+	if( probe->roomFloor != room->floor ) {
+		// the flipmap has swapped the room data
+		if( probe->pair < 0 ) return NULL;
+		probe = &ProbeRooms[probe->pair];
+		if( probe->roomFloor != room->floor ) return NULL;
+	}
+	if( probe->layers == 0 ) return NULL;
+
+	x -= room->x;
+	y -= room->maxCeiling;
+	z -= room->z;
+	if( x < 0 || y < 0 || z < 0 ) return NULL;
+	cx = x >> WALL_SHIFT;
+	cy = y >> WALL_SHIFT;
+	cz = z >> WALL_SHIFT;
+	if( cx >= room->ySize || cz >= room->xSize || cy >= probe->layers ) return NULL;
+
+	cell = (cx * room->xSize + cz) * probe->layers + cy;
+	*count = probe->cellStart[cell + 1] - probe->cellStart[cell];
+	return &ProbeLights[probe->cellStart[cell]];
+}
+#endif // FEATURE_RENDER_IMPROVED
@@ -21,6 +21,7 @@
 
 #include "global/precompiled.h"
 #include "modding/psx_bar.h"
+#include "3dsystem/3d_arena.h"
 #include "specific/hwr.h"
 #include "global/vars.h"
 
@@ -148,6 +149,7 @@ void __cdecl PSX_DrawAirBar(int x0, int y0, int x1, int y1, int bar, int pixel,
 
 static void PSX_InsertBar(int polytype, int x0, int y0, int x1, int y1, int bar, int pixel, int alpha) {
 	CLAMP(alpha, 0, 255);
+	POLYLIST_RESERVE;
 	Sort3dPtr->_0 = (DWORD)Info3dPtr;
 	Sort3dPtr->_1 = (DWORD)PhdNearZ;
 	++Sort3dPtr;
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/room_grid.h"
+#include "global/vars.h"
+#include <limits.h>
+
+#ifdef FEATURE_ENGINE_IMPROVED
+/*
+ * The grid cells are world sectors. Every room adds an entry to each cell
+ * of its footprint, the flipped rooms are added as well. The flipmap swaps
+ * the room data between the slots, so the entries are bound to the data by
+ * the floor pointer, and the current slot is resolved at query time. Thus
+ * FlipStatus is never checked here.
+ */
+typedef struct RoomGridEntry_t {
+	FLOOR_INFO *roomFloor; // the room data identity
+	FLOOR_INFO *sector; // the sector GetFloor takes for this cell
+	__int16 slot[2]; // the room slot at level load and its flipmap pair
+	__int16 index; // the floor data index the door flag is found for
+	bool isDoor;
+} ROOM_GRID_ENTRY;
+
+static ROOM_GRID_ENTRY *GridEntries = NULL;
+static int *GridCellStart = NULL;
+static int GridX = 0; // world origin of the grid
+static int GridZ = 0;
+static int GridSizeX = 0;
+static int GridSizeZ = 0;
+
+static bool IsIndexable(ROOM_INFO *room) {
+	// room positions are sector aligned, else the sectors do not match the cells
+	return ( room->floor != NULL && room->xSize > 1 && room->ySize > 1 &&
+		((room->x | room->z) & ((1 << WALL_SHIFT) - 1)) == 0 );
+}
+
+// The same floor data walk as GetDoor does. It does not stop at the end bit,
+// so it may find a door where GetDoor does not, but never the opposite
+static bool IsDoorSector(FLOOR_INFO *sector) {
+	if( !sector->index ) return false;
+	__int16 *data = &FloorData[sector->index];
+	__int16 type = *data++;
+	if( (type & FD_TYPE_MASK) == FT_TILT ) {
+		data++;
+		type = *data++;
+	}
+	if( (type & FD_TYPE_MASK) == FT_ROOF ) {
+		data++;
+		type = *data++;
+	}
+	return ( (type & FD_TYPE_MASK) == FT_DOOR );
+}
+
+// GetFloor moves the room corner sectors along the border, it's repeated here
+static FLOOR_INFO *GetRoomSector(ROOM_INFO *room, int xFloor, int yFloor) {
+	if( xFloor <= 0 ) {
+		xFloor = 0;
+		CLAMP(yFloor, 1, room->ySize - 2);
+	} else if( xFloor >= room->xSize - 1 ) {
+		xFloor = room->xSize - 1;
+		CLAMP(yFloor, 1, room->ySize - 2);
+	} else {
+		CLAMP(yFloor, 0, room->ySize - 1);
+	}
+	return &room->floor[xFloor + yFloor * room->xSize];
+}
+
+// The door flag is calculated at level load, but the doors may clear the index
+static bool IsDoorless(ROOM_GRID_ENTRY *entry) {
+	__int16 index = entry->sector->index;
+	return ( index == 0 || (index == entry->index && !entry->isDoor) );
+}
+
+static int GetCellIndex(int x, int z) {
+	int cx = (x - GridX) >> WALL_SHIFT;
+	int cz = (z - GridZ) >> WALL_SHIFT;
+	if( x < GridX || z < GridZ || cx >= GridSizeX || cz >= GridSizeZ ) return -1;
+	return cx * GridSizeZ + cz;
+}
+
+// Returns the slot that holds the entry room data now, or -1
+static int GetEntrySlot(ROOM_GRID_ENTRY *entry) {
+	for( int i = 0; i < 2; ++i ) {
+		if( entry->slot[i] >= 0 && RoomInfo[entry->slot[i]].floor == entry->roomFloor ) {
+			return entry->slot[i];
+		}
+	}
+	return -1;
+}
+
+void RGRID_LevelInit() {
+	int i, cx, cz, cell, cellCount, total = 0;
+	int xMin = INT_MAX, xMax = INT_MIN;
+	int zMin = INT_MAX, zMax = INT_MIN;
+	__int16 *pairs = NULL;
+	int *cellFill = NULL;
+
+	RGRID_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		if( !IsIndexable(room) ) continue;
+		xMin = MIN(xMin, room->x);
+		xMax = MAX(xMax, room->x + (room->ySize << WALL_SHIFT));
+		zMin = MIN(zMin, room->z);
+		zMax = MAX(zMax, room->z + (room->xSize << WALL_SHIFT));
+		total += room->xSize * room->ySize;
+	}
+	if( total == 0 ) return;
+
+	GridX = xMin;
+	GridZ = zMin;
+	GridSizeX = (xMax - xMin) >> WALL_SHIFT;
+	GridSizeZ = (zMax - zMin) >> WALL_SHIFT;
+	cellCount = GridSizeX * GridSizeZ;
+	GridCellStart = (int *)calloc(cellCount + 1, sizeof(int));
+	GridEntries = (ROOM_GRID_ENTRY *)malloc(sizeof(ROOM_GRID_ENTRY) * total);
+	pairs = (__int16 *)malloc(sizeof(__int16) * RoomCount);
+	cellFill = (int *)calloc(cellCount, sizeof(int));
+	if( GridCellStart == NULL || GridEntries == NULL || pairs == NULL || cellFill == NULL ) {
+		RGRID_Cleanup();
+		goto CLEANUP;
+	}
+
+	// the flipmap pair is the same in both flip states
+	for( i = 0; i < RoomCount; ++i ) {
+		pairs[i] = -1;
+	}
+	for( i = 0; i < RoomCount; ++i ) {
+		__int16 flipped = RoomInfo[i].flippedRoom;
+		if( flipped >= 0 && flipped < RoomCount ) {
+			pairs[i] = flipped;
+			pairs[flipped] = i;
+		}
+	}
+
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		if( !IsIndexable(room) ) continue;
+		for( cx = 0; cx < room->ySize; ++cx ) {
+			for( cz = 0; cz < room->xSize; ++cz ) {
+				++GridCellStart[GetCellIndex(room->x + (cx << WALL_SHIFT), room->z + (cz << WALL_SHIFT)) + 1];
+			}
+		}
+	}
+	for( cell = 0; cell < cellCount; ++cell ) {
+		GridCellStart[cell + 1] += GridCellStart[cell];
+	}
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		if( !IsIndexable(room) ) continue;
+		for( cx = 0; cx < room->ySize; ++cx ) {
+			for( cz = 0; cz < room->xSize; ++cz ) {
+				cell = GetCellIndex(room->x + (cx << WALL_SHIFT), room->z + (cz << WALL_SHIFT));
+				ROOM_GRID_ENTRY *entry = &GridEntries[GridCellStart[cell] + cellFill[cell]++];
+				entry->roomFloor = room->floor;
+				entry->sector = GetRoomSector(room, cz, cx);
+				entry->slot[0] = i;
+				entry->slot[1] = pairs[i];
+				entry->index = entry->sector->index;
+				entry->isDoor = IsDoorSector(entry->sector);
+			}
+		}
+	}
+
+CLEANUP :
+	if( pairs != NULL ) free(pairs);
+	if( cellFill != NULL ) free(cellFill);
+}
+
+void RGRID_Cleanup() {
+	if( GridEntries != NULL ) {
+		free(GridEntries);
+		GridEntries = NULL;
+	}
+	if( GridCellStart != NULL ) {
+		free(GridCellStart);
+		GridCellStart = NULL;
+	}
+	GridX = GridZ = 0;
+	GridSizeX = GridSizeZ = 0;
+}
+
+/*
+ * Returns true if GetFloor leaves the room number unchanged for the point.
+ * The sector must have no horizontal door, and the point must not go
+ * through its pit or sky. The sector heights and doors are changed by the
+ * game objects, so they are checked live. If false is returned, the point
+ * may still be in the room, and GetFloor has to be called to find it out.
+ */
+bool RGRID_IsRoomSector(int x, int y, int z, __int16 roomID) {
+	ROOM_GRID_ENTRY *entry = NULL;
+	FLOOR_INFO *roomFloor, *sector;
+	int i, cell;
+
+	if( GridEntries == NULL || roomID < 0 || roomID >= RoomCount ) return false;
+	cell = GetCellIndex(x, z);
+	if( cell < 0 ) return false;
+	roomFloor = RoomInfo[roomID].floor;
+	for( i = GridCellStart[cell]; i < GridCellStart[cell + 1]; ++i ) {
+		if( GridEntries[i].roomFloor == roomFloor ) {
+			entry = &GridEntries[i];
+			break;
+		}
+	}
+	if( entry == NULL ) return false;
+
+	if( !IsDoorless(entry) ) return false;
+	sector = entry->sector;
+	if( y >= (sector->floor << 8) ) {
+		return ( (BYTE)sector->pitRoom == NO_ROOM );
+	}
+	if( y < (sector->ceiling << 8) ) {
+		return ( (BYTE)sector->skyRoom == NO_ROOM );
+	}
+	return true;
+}
+
+/*
+ * Finds the room for the point without the seed room. The room which sector
+ * contains the point between its floor and ceiling is preferred. Otherwise
+ * the room which vertical bounds contain the point is taken. The overlapped
+ * rooms are possible, so the seeded GetFloor is still the right way if the
+ * seed room is known. Returns -1 if there is no room at the point.
+ */
+__int16 RGRID_GetRoom(int x, int y, int z) {
+	int i, cell, slot;
+	__int16 result = -1;
+
+	if( GridEntries == NULL ) return -1;
+	cell = GetCellIndex(x, z);
+	if( cell < 0 ) return -1;
+	for( i = GridCellStart[cell]; i < GridCellStart[cell + 1]; ++i ) {
+		ROOM_GRID_ENTRY *entry = &GridEntries[i];
+		slot = GetEntrySlot(entry);
+		if( slot < 0 ) continue;
+		FLOOR_INFO *sector = entry->sector;
+		if( (sector->floor << 8) != NO_HEIGHT && IsDoorless(entry) &&
+			y >= (sector->ceiling << 8) && y <= (sector->floor << 8) )
+		{
+			return slot;
+		}
+		if( result < 0 && y >= RoomInfo[slot].maxCeiling && y <= RoomInfo[slot].minFloor ) {
+			result = slot;
+		}
+	}
+	return result;
+}
+#endif // FEATURE_ENGINE_IMPROVED
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/room_pvs.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_RENDER_IMPROVED
+#define PVS_MAGIC			(0x32535650) // "PVS2"
+#define PVS_EXTENSION		"PVS"
+// The camera room is got by the camera sector, but the camera may be a bit
+// above the ceiling or below the floor of the room
+#define PVS_CAMERA_MARGIN	(256)
+
+typedef struct PvsPortal_t {
+	int room; // the room behind the portal
+	int nx, ny, nz; // the normal looks to the room having the portal
+	double d;
+	int v[4][3]; // world coordinates
+} PVS_PORTAL;
+
+typedef struct PvsBox_t {
+	int min[3];
+	int max[3];
+} PVS_BOX;
+
+typedef struct PvsFileHeader_t {
+	DWORD magic;
+	DWORD roomCount;
+	DWORD hash;
+} PVS_FILE_HEADER;
+
+static DWORD *PvsBits = NULL;
+static DWORD PvsRowSize = 0; // in DWORDs
+static DWORD *PvsCameraRow = NULL;
+static PVS_BOX *PvsBoxes = NULL; // the camera box of each room row
+
+// Room slot index gets the alternative room data on flipmap, so both versions are used
+static int GetRoomVersions(int roomNumber, ROOM_INFO **versions) {
+	int count = 0;
+	versions[count++] = &RoomInfo[roomNumber];
+	if( RoomInfo[roomNumber].flippedRoom >= 0 ) {
+		versions[count++] = &RoomInfo[RoomInfo[roomNumber].flippedRoom];
+	}
+	for( int i = 0; i < RoomCount; ++i ) {
+		if( RoomInfo[i].flippedRoom == roomNumber ) {
+			versions[count++] = &RoomInfo[i];
+			break;
+		}
+	}
+	return count;
+}
+
+static DWORD HashRooms() {
+	DWORD hash = 0x811C9DC5;
+	BYTE *ptr;
+	DWORD size;
+
+	for( int i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		int values[7] = {room->x, room->z, room->xSize, room->ySize, room->minFloor, room->maxCeiling, room->flippedRoom};
+		ptr = (BYTE *)values;
+		for( size = sizeof(values); size > 0; --size ) {
+			hash = (hash ^ *ptr++) * 0x01000193;
+		}
+		if( room->doors != NULL ) {
+			ptr = (BYTE *)room->doors;
+			for( size = sizeof(__int16) + sizeof(DOOR_INFO) * room->doors->wCount; size > 0; --size ) {
+				hash = (hash ^ *ptr++) * 0x01000193;
+			}
+		}
+	}
+	return hash;
+}
+
+// NOTE: ChangeFileNameExtension() can't be used here, the full path may start with a dot
+static bool GetCacheFileName(char *fileName, DWORD size) {
+	char *extension;
+
+	if( !*LevelFileName || (DWORD)lstrlen(LevelFileName) + 5 > size ) return false;
+	lstrcpy(fileName, LevelFileName);
+	extension = PathFindExtension(fileName);
+	lstrcpy(extension, "." PVS_EXTENSION);
+	return true;
+}
+
+static bool LoadCache(DWORD hash) {
+	char fileName[256];
+	PVS_FILE_HEADER header;
+	DWORD size = sizeof(DWORD) * PvsRowSize * RoomCount;
+	DWORD bytesRead = 0;
+	HANDLE hFile;
+	bool result = false;
+
+	if( !GetCacheFileName(fileName, sizeof(fileName)) ) return false;
+	hFile = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN|FILE_ATTRIBUTE_NORMAL, NULL);
+	if( hFile == INVALID_HANDLE_VALUE ) return false;
+
+	if( ReadFile(hFile, &header, sizeof(header), &bytesRead, NULL) && bytesRead == sizeof(header)
+		&& header.magic == PVS_MAGIC && header.roomCount == (DWORD)RoomCount && header.hash == hash
+		&& ReadFile(hFile, PvsBits, size, &bytesRead, NULL) && bytesRead == size )
+	{
+		result = true;
+	}
+	CloseHandle(hFile);
+	return result;
+}
+
+static void SaveCache(DWORD hash) {
+	char fileName[256];
+	PVS_FILE_HEADER header = {PVS_MAGIC, (DWORD)RoomCount, hash};
+	DWORD size = sizeof(DWORD) * PvsRowSize * RoomCount;
+	DWORD bytesWritten = 0;
+	HANDLE hFile;
+
+	if( !GetCacheFileName(fileName, sizeof(fileName)) ) return;
+	hFile = CreateFile(fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if( hFile == INVALID_HANDLE_VALUE ) return; // the data folder may be read only, it's ok
+
+	WriteFile(hFile, &header, sizeof(header), &bytesWritten, NULL);
+	WriteFile(hFile, PvsBits, size, &bytesWritten, NULL);
+	CloseHandle(hFile);
+}
+
+// The room row is valid for the camera inside this box only
+static void GetCameraBox(int roomNumber, PVS_BOX *box) {
+	ROOM_INFO *versions[3];
+	int count = GetRoomVersions(roomNumber, versions);
+
+	box->min[0] = box->min[1] = box->min[2] = 0x7FFFFFFF;
+	box->max[0] = box->max[1] = box->max[2] = -0x7FFFFFFF;
+	for( int i = 0; i < count; ++i ) {
+		CLAMPG(box->min[0], versions[i]->x);
+		CLAMPG(box->min[1], versions[i]->maxCeiling - PVS_CAMERA_MARGIN);
+		CLAMPG(box->min[2], versions[i]->z);
+		// xSize is the number of sectors along Z, ySize along X
+		CLAMPL(box->max[0], versions[i]->x + (versions[i]->ySize << WALL_SHIFT));
+		CLAMPL(box->max[1], versions[i]->minFloor + PVS_CAMERA_MARGIN);
+		CLAMPL(box->max[2], versions[i]->z + (versions[i]->xSize << WALL_SHIFT));
+	}
+}
+
+// Checks if any point of the camera box is in front of the portal
+static bool IsBoxInFront(PVS_BOX *box, PVS_PORTAL *portal) {
+	double x = ( portal->nx > 0 ) ? box->max[0] : box->min[0];
+	double y = ( portal->ny > 0 ) ? box->max[1] : box->min[1];
+	double z = ( portal->nz > 0 ) ? box->max[2] : box->min[2];
+	return ( portal->nx * x + portal->ny * y + portal->nz * z > portal->d );
+}
+
+// Checks if any portal vertex is behind the plane of the portal that is already passed
+static bool IsPortalBehind(PVS_PORTAL *portal, PVS_PORTAL *passed) {
+	for( int i = 0; i < 4; ++i ) {
+		if( passed->nx * (double)portal->v[i][0] + passed->ny * (double)portal->v[i][1]
+			+ passed->nz * (double)portal->v[i][2] <= passed->d )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool IsPortalReverse(PVS_PORTAL *portal, PVS_PORTAL *passed) {
+	return ( portal->nx == -passed->nx && portal->ny == -passed->ny
+		&& portal->nz == -passed->nz && portal->d == -passed->d );
+}
+
+/*
+ * A room is potentially visible if there is a portal chain where the camera
+ * box may be in front of every portal, and every next portal is at least
+ * partially behind the first portal and the previous one. The other chain
+ * portals are not checked, so the result is conservative.
+ */
+static void BuildPvs() {
+	PVS_PORTAL *portals;
+	int **roomPortals, *roomPortalCount, *roomPortalBase;
+	int *stack, *firstVisited;
+	ROOM_INFO *versions[3];
+	int i, j, k, count, total = 0;
+
+	roomPortalBase = (int *)malloc(sizeof(int) * RoomCount);
+	roomPortalCount = (int *)calloc(RoomCount, sizeof(int));
+	roomPortals = (int **)calloc(RoomCount, sizeof(int *));
+	if( roomPortalBase == NULL || roomPortalCount == NULL || roomPortals == NULL ) {
+		portals = NULL;
+		stack = firstVisited = NULL;
+		goto FAIL;
+	}
+	for( i = 0; i < RoomCount; ++i ) {
+		roomPortalBase[i] = total;
+		if( RoomInfo[i].doors != NULL ) {
+			total += RoomInfo[i].doors->wCount;
+		}
+	}
+	portals = (PVS_PORTAL *)malloc(sizeof(PVS_PORTAL) * (total + 1));
+	stack = (int *)malloc(sizeof(int) * (total + 1));
+	firstVisited = (int *)malloc(sizeof(int) * (total + 1));
+	if( portals == NULL || stack == NULL || firstVisited == NULL ) {
+		goto FAIL;
+	}
+
+	// Convert the doors to world space portals
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		if( room->doors == NULL ) continue;
+		for( j = 0; j < room->doors->wCount; ++j ) {
+			DOOR_INFO *door = &room->doors->door[j];
+			PVS_PORTAL *portal = &portals[roomPortalBase[i] + j];
+			portal->room = door->room;
+			portal->nx = door->x;
+			portal->ny = door->y;
+			portal->nz = door->z;
+			for( k = 0; k < 4; ++k ) {
+				portal->v[k][0] = room->x + door->vertex[k].x;
+				portal->v[k][1] = room->y + door->vertex[k].y;
+				portal->v[k][2] = room->z + door->vertex[k].z;
+			}
+			portal->d = (double)portal->nx * portal->v[0][0]
+					  + (double)portal->ny * portal->v[0][1]
+					  + (double)portal->nz * portal->v[0][2];
+		}
+	}
+
+	// Gather the portals of all room slot versions
+	for( i = 0; i < RoomCount; ++i ) {
+		count = GetRoomVersions(i, versions);
+		for( j = 0; j < count; ++j ) {
+			if( versions[j]->doors != NULL ) {
+				roomPortalCount[i] += versions[j]->doors->wCount;
+			}
+		}
+		roomPortals[i] = (int *)malloc(sizeof(int) * (roomPortalCount[i] + 1));
+		if( roomPortals[i] == NULL ) {
+			goto FAIL;
+		}
+		roomPortalCount[i] = 0;
+		for( j = 0; j < count; ++j ) {
+			int base = roomPortalBase[versions[j] - RoomInfo];
+			if( versions[j]->doors == NULL ) continue;
+			for( k = 0; k < versions[j]->doors->wCount; ++k ) {
+				roomPortals[i][roomPortalCount[i]++] = base + k;
+			}
+		}
+	}
+
+	for( i = 0; i < RoomCount; ++i ) {
+		DWORD *row = &PvsBits[PvsRowSize * i];
+		PVS_BOX *box = &PvsBoxes[i];
+
+		row[i / 32] |= 1 << (i % 32);
+
+		for( k = 0; k < total; ++k ) {
+			firstVisited[k] = -1;
+		}
+		for( j = 0; j < roomPortalCount[i]; ++j ) {
+			PVS_PORTAL *first = &portals[roomPortals[i][j]];
+			int sp = 0;
+
+			if( !IsBoxInFront(box, first) ) continue;
+			// the portals are marked as visited for the current first portal
+			firstVisited[roomPortals[i][j]] = j;
+			stack[sp++] = roomPortals[i][j];
+
+			while( sp > 0 ) {
+				PVS_PORTAL *prev = &portals[stack[--sp]];
+				int room = prev->room;
+				row[room / 32] |= 1 << (room % 32);
+				for( k = 0; k < roomPortalCount[room]; ++k ) {
+					int idx = roomPortals[room][k];
+					PVS_PORTAL *portal = &portals[idx];
+					if( firstVisited[idx] == j
+						|| IsPortalReverse(portal, prev)
+						|| !IsBoxInFront(box, portal)
+						|| !IsPortalBehind(portal, prev)
+						|| !IsPortalBehind(portal, first) )
+					{
+						continue;
+					}
+					firstVisited[idx] = j;
+					stack[sp++] = idx;
+				}
+			}
+		}
+	}
+	goto CLEANUP;
+
+FAIL :
+	// leave everything visible
+	memset(PvsBits, 0xFF, sizeof(DWORD) * PvsRowSize * RoomCount);
+
+CLEANUP :
+	if( roomPortals != NULL ) {
+		for( i = 0; i < RoomCount; ++i ) {
+			if( roomPortals[i] != NULL ) free(roomPortals[i]);
+		}
+		free(roomPortals);
+	}
+	if( roomPortalBase != NULL ) free(roomPortalBase);
+	if( roomPortalCount != NULL ) free(roomPortalCount);
+	if( portals != NULL ) free(portals);
+	if( stack != NULL ) free(stack);
+	if( firstVisited != NULL ) free(firstVisited);
+}
+
+void PVS_LevelInit() {
+	DWORD hash;
+
+	PVS_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	PvsRowSize = (RoomCount + 31) / 32;
+	PvsBits = (DWORD *)calloc(PvsRowSize * RoomCount, sizeof(DWORD));
+	PvsBoxes = (PVS_BOX *)malloc(sizeof(PVS_BOX) * RoomCount);
+	if( PvsBits == NULL || PvsBoxes == NULL ) {
+		PVS_Cleanup();
+		return;
+	}
+	for( int i = 0; i < RoomCount; ++i ) {
+		GetCameraBox(i, &PvsBoxes[i]);
+	}
+
+	hash = HashRooms();
+	if( !LoadCache(hash) ) {
+		BuildPvs();
+		SaveCache(hash);
+	}
+}
+
+void PVS_Cleanup() {
+	if( PvsBits != NULL ) {
+		free(PvsBits);
+		PvsBits = NULL;
+	}
+	if( PvsBoxes != NULL ) {
+		free(PvsBoxes);
+		PvsBoxes = NULL;
+	}
+	PvsRowSize = 0;
+	PvsCameraRow = NULL;
+}
+
+/*
+ * The room row is used only if the camera is inside the camera box of the
+ * room. Fixed cameras and the cameras clamped to an edge sector may be out
+ * of their room, so all rooms are left for the portal walk in that case.
+ */
+void PVS_SetCameraRoom(int roomNumber, int x, int y, int z) {
+	PvsCameraRow = NULL;
+	if( PvsBits == NULL || roomNumber < 0 || roomNumber >= RoomCount ) {
+		return;
+	}
+	PVS_BOX *box = &PvsBoxes[roomNumber];
+	if( x < box->min[0] || x > box->max[0]
+		|| y < box->min[1] || y > box->max[1]
+		|| z < box->min[2] || z > box->max[2] )
+	{
+		return;
+	}
+	PvsCameraRow = &PvsBits[PvsRowSize * roomNumber];
+}
+
+bool PVS_IsRoomVisible(int roomNumber) {
+	return ( PvsCameraRow == NULL || CHK_ANY(PvsCameraRow[roomNumber / 32], 1 << (roomNumber % 32)) );
+}
+#endif // FEATURE_RENDER_IMPROVED
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/sample_bank.h"
+#include "specific/file.h"
+#include "specific/init.h"
+#include "specific/init_sound.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_LOADING_IMPROVED
+#define SFX_MAX_BANKS	(4)
+
+typedef struct SfxBankEntry_t {
+	WAVEPCM_HEADER header;
+	DWORD offset; // of the wave data
+	DWORD dataSize; // aligned
+	LPDIRECTSOUNDBUFFER buffer;
+	DWORD frequency;
+	bool isUsed;
+} SFX_BANK_ENTRY;
+
+typedef struct SfxBank_t {
+	char fileName[256];
+	DWORD fileSize;
+	SFX_BANK_ENTRY *entries;
+	DWORD entryCount;
+} SFX_BANK;
+
+// The banks live for the whole session, so the next level reads only the samples
+// which the previous level had not used. Each cached sound buffer is held by the
+// bank, and the level sample slots take their own references to it.
+static SFX_BANK SfxBanks[SFX_MAX_BANKS];
+static int SfxNextBank = 0;
+
+static void FreeBankBuffers(SFX_BANK *bank, bool unusedOnly) {
+	for( DWORD i = 0; i < bank->entryCount; ++i ) {
+		if( bank->entries[i].buffer != NULL && !(unusedOnly && bank->entries[i].isUsed) ) {
+			bank->entries[i].buffer->Release();
+			bank->entries[i].buffer = NULL;
+		}
+	}
+}
+
+static void FreeBank(SFX_BANK *bank) {
+	FreeBankBuffers(bank, false);
+	if( bank->entries != NULL ) {
+		free(bank->entries);
+	}
+	memset(bank, 0, sizeof(SFX_BANK));
+}
+
+// Walks the RIFF headers once and keeps the offset and the format of every sample
+static bool IndexBank(SFX_BANK *bank, HANDLE hFile) {
+	DWORD bytesRead;
+	DWORD offset = 0;
+	DWORD capacity = 0;
+	WAVEPCM_HEADER header;
+
+	while( offset + sizeof(WAVEPCM_HEADER) <= bank->fileSize ) {
+		SetFilePointer(hFile, offset, NULL, FILE_BEGIN);
+		if( !ReadFile(hFile, &header, sizeof(WAVEPCM_HEADER), &bytesRead, NULL) || bytesRead != sizeof(WAVEPCM_HEADER) ) {
+			break;
+		}
+		if( header.dwRiffChunkID != 0x46464952 || // "RIFF"
+			header.dwFormat != 0x45564157 || // "WAVE"
+			header.dwDataSubchunkID != 0x61746164 ) // "data"
+		{
+			break;
+		}
+		if( bank->entryCount == capacity ) {
+			capacity = capacity ? capacity * 2 : 256;
+			SFX_BANK_ENTRY *entries = (SFX_BANK_ENTRY *)realloc(bank->entries, sizeof(SFX_BANK_ENTRY) * capacity);
+			if( entries == NULL ) {
+				return false;
+			}
+			bank->entries = entries;
+		}
+		SFX_BANK_ENTRY *entry = &bank->entries[bank->entryCount++];
+		memset(entry, 0, sizeof(SFX_BANK_ENTRY));
+		entry->header = header;
+		entry->offset = offset + sizeof(WAVEPCM_HEADER);
+		entry->dataSize = (header.dwDataSubchunkSize + 1) & ~1; // aligned data size
+		offset = entry->offset + entry->dataSize;
+	}
+	return true;
+}
+
+static SFX_BANK *GetBank(LPCTSTR fileName, HANDLE hFile) {
+	SFX_BANK *bank = NULL;
+	DWORD fileSize = GetFileSize(hFile, NULL);
+
+	for( int i = 0; i < SFX_MAX_BANKS; ++i ) {
+		if( !lstrcmpi(SfxBanks[i].fileName, fileName) ) {
+			bank = &SfxBanks[i];
+			break;
+		}
+	}
+	if( bank != NULL && bank->fileSize == fileSize ) {
+		return bank;
+	}
+	if( bank == NULL ) {
+		bank = &SfxBanks[SfxNextBank];
+		SfxNextBank = (SfxNextBank + 1) % SFX_MAX_BANKS;
+	}
+	FreeBank(bank);
+	lstrcpyn(bank->fileName, fileName, sizeof(bank->fileName));
+	bank->fileSize = fileSize;
+	if( fileSize == INVALID_FILE_SIZE || !IndexBank(bank, hFile) ) {
+		FreeBank(bank);
+		return NULL;
+	}
+	return bank;
+}
+
+/*
+ * Fills the level sample slots with the samples of the SFX file, taking the
+ * cached ones from the bank. The file samples are referred by sampleIndexes,
+ * which must be sorted. Returns the number of filled slots; this is less than
+ * sampleCount if the file has fewer samples or a sample fails to load.
+ * Returns -1 if the file cannot be opened.
+ */
+int SFX_LoadSamples(LPCTSTR fileName, int *sampleIndexes, int sampleCount) {
+	HANDLE hFile;
+	SFX_BANK *bank;
+	DWORD bytesRead;
+	LPVOID waveData;
+	WAVEPCM_HEADER header;
+	int i;
+
+	hFile = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if( hFile == INVALID_HANDLE_VALUE ) {
+		return -1;
+	}
+	bank = GetBank(fileName, hFile);
+	if( bank == NULL ) {
+		CloseHandle(hFile);
+		return 0;
+	}
+
+	for( DWORD j = 0; j < bank->entryCount; ++j ) {
+		bank->entries[j].isUsed = false;
+	}
+	for( i = 0; i < sampleCount; ++i ) {
+		if( sampleIndexes[i] < 0 || (DWORD)sampleIndexes[i] >= bank->entryCount || (DWORD)i >= ARRAY_SIZE(SampleBuffers) ) {
+			break;
+		}
+		SFX_BANK_ENTRY *entry = &bank->entries[sampleIndexes[i]];
+		if( entry->buffer == NULL ) {
+			header = entry->header;
+			((LPWAVEFORMATEX)&header.wFormatTag)->cbSize = 0;
+			waveData = game_malloc(entry->dataSize, GBUF_Samples);
+			SetFilePointer(hFile, entry->offset, NULL, FILE_BEGIN);
+			ReadFileSync(hFile, waveData, entry->dataSize, &bytesRead, NULL);
+			if( !WinSndMakeSample(i, (LPWAVEFORMATEX)&header.wFormatTag, waveData, entry->dataSize) ) {
+				game_free(entry->dataSize);
+				break;
+			}
+			game_free(entry->dataSize);
+			entry->buffer = SampleBuffers[i];
+			entry->buffer->AddRef();
+			entry->frequency = SampleFreqs[i];
+		} else {
+			if( SampleBuffers[i] != NULL ) {
+				SampleBuffers[i]->Release();
+			}
+			SampleBuffers[i] = entry->buffer;
+			SampleBuffers[i]->AddRef();
+			SampleFreqs[i] = entry->frequency;
+		}
+		entry->isUsed = true;
+	}
+	CloseHandle(hFile);
+
+	// The samples not needed by this level are dropped, so the bank does not grow endlessly
+	FreeBankBuffers(bank, true);
+	return i;
+}
+
+void SFX_Cleanup() {
+	for( int i = 0; i < SFX_MAX_BANKS; ++i ) {
+		FreeBank(&SfxBanks[i]);
+	}
+	SfxNextBank = 0;
+}
+#endif // FEATURE_LOADING_IMPROVED
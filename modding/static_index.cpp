@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/static_index.h"
+#include "global/vars.h"
+#include <limits.h>
+
+#ifdef FEATURE_SIMD_RENDER
+#include "3dsystem/3d_simd.h"
+#include <immintrin.h>
+
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_ENGINE_IMPROVED
+// Room statics are bucketed by square cells of 2x2 sectors
+#define SIDX_CELL_SHIFT	(WALL_SHIFT + 1)
+// Cell lists are padded by never colliding boxes to be tested by 4
+#define SIDX_LANES		(4)
+
+typedef struct StaticIndexRoom_t {
+	MESH_INFO *mesh; // the index is found by it after the flipmap swap
+	int numMeshes;
+	int x, z; // the grid origin
+	int gridX, gridZ;
+	int *cellStart; // gridX*gridZ+1 entries
+	int *meshIndex;
+	// world space collision boxes, structure of arrays
+	int *xMin, *xMax;
+	int *yMin, *yMax;
+	int *zMin, *zMax;
+} STATIC_INDEX_ROOM;
+
+static STATIC_INDEX_ROOM *IndexRooms = NULL;
+static int IndexRoomsCount = 0;
+static int *IndexPool = NULL;
+
+// The same box as CollideStaticObjects calculates for the mesh
+static void GetStaticBox(MESH_INFO *mesh, int *box) {
+	STATIC_BOUNDS *bounds = &StaticObjects[mesh->staticNumber].collisionBounds;
+	int xMin = mesh->x;
+	int xMax = mesh->x;
+	int zMin = mesh->z;
+	int zMax = mesh->z;
+
+	switch( mesh->yRot ) {
+		case -PHD_90: // west
+			xMin -= bounds->zMax;
+			xMax -= bounds->zMin;
+			zMin += bounds->xMin;
+			zMax += bounds->xMax;
+			break;
+		case -PHD_180: // south
+			xMin -= bounds->xMax;
+			xMax -= bounds->xMin;
+			zMin -= bounds->zMax;
+			zMax -= bounds->zMin;
+			break;
+		case PHD_90: // east
+			xMin += bounds->zMin;
+			xMax += bounds->zMax;
+			zMin -= bounds->xMax;
+			zMax -= bounds->xMin;
+			break;
+		default: // north
+			xMin += bounds->xMin;
+			xMax += bounds->xMax;
+			zMin += bounds->zMin;
+			zMax += bounds->zMax;
+			break;
+	}
+	box[0] = xMin;
+	box[1] = xMax;
+	box[2] = mesh->y + bounds->yMin;
+	box[3] = mesh->y + bounds->yMax;
+	box[4] = zMin;
+	box[5] = zMax;
+}
+
+static inline int GetCell(int pos, int origin, int gridSize) {
+	int cell = (pos - origin) >> SIDX_CELL_SHIFT;
+	CLAMP(cell, 0, gridSize - 1);
+	return cell;
+}
+
+static bool IsCollidable(MESH_INFO *mesh) {
+	return !CHK_ANY(StaticObjects[mesh->staticNumber].flags, 1);
+}
+
+// Counts the padded entries of the room cells, or fills them if pool is not NULL
+static int BuildRoomIndex(ROOM_INFO *room, STATIC_INDEX_ROOM *index, int *pool) {
+	int box[6];
+	int i, cx, cz, cell, cellCount, total = 0;
+	int *cellFill = NULL;
+
+	index->mesh = room->mesh;
+	index->numMeshes = room->numMeshes;
+	index->x = room->x;
+	index->z = room->z;
+	index->gridX = MAX(1, ((room->ySize << WALL_SHIFT) + (1 << SIDX_CELL_SHIFT) - 1) >> SIDX_CELL_SHIFT);
+	index->gridZ = MAX(1, ((room->xSize << WALL_SHIFT) + (1 << SIDX_CELL_SHIFT) - 1) >> SIDX_CELL_SHIFT);
+	cellCount = index->gridX * index->gridZ;
+
+	int *counts = (int *)calloc(cellCount, sizeof(int));
+	if( counts == NULL ) return -1;
+	for( i = 0; i < room->numMeshes; ++i ) {
+		if( !IsCollidable(&room->mesh[i]) ) continue;
+		GetStaticBox(&room->mesh[i], box);
+		for( cx = GetCell(box[0], index->x, index->gridX); cx <= GetCell(box[1], index->x, index->gridX); ++cx ) {
+			for( cz = GetCell(box[4], index->z, index->gridZ); cz <= GetCell(box[5], index->z, index->gridZ); ++cz ) {
+				++counts[cx * index->gridZ + cz];
+			}
+		}
+	}
+	for( cell = 0; cell < cellCount; ++cell ) {
+		total += (counts[cell] + SIDX_LANES - 1) & ~(SIDX_LANES - 1);
+	}
+	if( pool == NULL ) {
+		free(counts);
+		return total * 7 + cellCount + 1; // cellStart is in the pool too
+	}
+
+	index->cellStart = pool;
+	index->meshIndex = pool + cellCount + 1;
+	index->xMin = index->meshIndex + total;
+	index->xMax = index->xMin + total;
+	index->yMin = index->xMax + total;
+	index->yMax = index->yMin + total;
+	index->zMin = index->yMax + total;
+	index->zMax = index->zMin + total;
+	index->cellStart[0] = 0;
+	for( cell = 0; cell < cellCount; ++cell ) {
+		index->cellStart[cell + 1] = index->cellStart[cell] + ((counts[cell] + SIDX_LANES - 1) & ~(SIDX_LANES - 1));
+	}
+	// the padding boxes are empty, so they never collide
+	for( i = 0; i < total; ++i ) {
+		index->meshIndex[i] = room->numMeshes;
+		index->xMin[i] = index->yMin[i] = index->zMin[i] = INT_MAX;
+		index->xMax[i] = index->yMax[i] = index->zMax[i] = INT_MIN;
+	}
+	// the meshes are added in ascending order, so every cell list is sorted
+	cellFill = counts;
+	memset(cellFill, 0, sizeof(int) * cellCount);
+	for( i = 0; i < room->numMeshes; ++i ) {
+		if( !IsCollidable(&room->mesh[i]) ) continue;
+		GetStaticBox(&room->mesh[i], box);
+		for( cx = GetCell(box[0], index->x, index->gridX); cx <= GetCell(box[1], index->x, index->gridX); ++cx ) {
+			for( cz = GetCell(box[4], index->z, index->gridZ); cz <= GetCell(box[5], index->z, index->gridZ); ++cz ) {
+				cell = cx * index->gridZ + cz;
+				int k = index->cellStart[cell] + cellFill[cell]++;
+				index->meshIndex[k] = i;
+				index->xMin[k] = box[0];
+				index->xMax[k] = box[1];
+				index->yMin[k] = box[2];
+				index->yMax[k] = box[3];
+				index->zMin[k] = box[4];
+				index->zMax[k] = box[5];
+			}
+		}
+	}
+	free(counts);
+	return total * 7 + cellCount + 1;
+}
+
+static STATIC_INDEX_ROOM *FindRoomIndex(int roomNumber) {
+	ROOM_INFO *room;
+	STATIC_INDEX_ROOM *index;
+
+	if( roomNumber < 0 || roomNumber >= IndexRoomsCount ) return NULL;
+	room = &RoomInfo[roomNumber];
+	index = &IndexRooms[roomNumber];
+	if( index->mesh == room->mesh && index->numMeshes == room->numMeshes ) return index;
+	// The flipmap swaps the room data, so the index may be in the other slot
+	if( room->flippedRoom >= 0 && room->flippedRoom < IndexRoomsCount ) {
+		index = &IndexRooms[room->flippedRoom];
+		if( index->mesh == room->mesh && index->numMeshes == room->numMeshes ) return index;
+	}
+	return NULL;
+}
+
+// Returns the first colliding entry of the cell list or -1
+static int ScanCell(STATIC_INDEX_ROOM *index, int start, int end, int *query) {
+	for( int k = start; k < end; ++k ) {
+		if( query[1] > index->xMin[k] && query[0] < index->xMax[k] &&
+			query[3] > index->yMin[k] && query[2] < index->yMax[k] &&
+			query[5] > index->zMin[k] && query[4] < index->zMax[k] )
+		{
+			return k;
+		}
+	}
+	return -1;
+}
+
+#ifdef FEATURE_SIMD_RENDER
+static SIMD_TARGET("sse2") int ScanCellSSE2(STATIC_INDEX_ROOM *index, int start, int end, int *query) {
+	__m128i qxMin = _mm_set1_epi32(query[0]);
+	__m128i qxMax = _mm_set1_epi32(query[1]);
+	__m128i qyMin = _mm_set1_epi32(query[2]);
+	__m128i qyMax = _mm_set1_epi32(query[3]);
+	__m128i qzMin = _mm_set1_epi32(query[4]);
+	__m128i qzMax = _mm_set1_epi32(query[5]);
+
+	for( int k = start; k < end; k += SIDX_LANES ) {
+		__m128i hit = _mm_and_si128(
+			_mm_cmpgt_epi32(qxMax, _mm_loadu_si128((__m128i *)&index->xMin[k])),
+			_mm_cmplt_epi32(qxMin, _mm_loadu_si128((__m128i *)&index->xMax[k])));
+		hit = _mm_and_si128(hit, _mm_and_si128(
+			_mm_cmpgt_epi32(qyMax, _mm_loadu_si128((__m128i *)&index->yMin[k])),
+			_mm_cmplt_epi32(qyMin, _mm_loadu_si128((__m128i *)&index->yMax[k]))));
+		hit = _mm_and_si128(hit, _mm_and_si128(
+			_mm_cmpgt_epi32(qzMax, _mm_loadu_si128((__m128i *)&index->zMin[k])),
+			_mm_cmplt_epi32(qzMin, _mm_loadu_si128((__m128i *)&index->zMax[k]))));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+		if( mask != 0 ) {
+			return k + __builtin_ctz(mask);
+		}
+	}
+	return -1;
+}
+#endif // FEATURE_SIMD_RENDER
+
+void SIDX_LevelInit() {
+	int i, size = 0, offset = 0;
+
+	SIDX_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	IndexRooms = (STATIC_INDEX_ROOM *)calloc(RoomCount, sizeof(STATIC_INDEX_ROOM));
+	if( IndexRooms == NULL ) return;
+	for( i = 0; i < RoomCount; ++i ) {
+		int roomSize = BuildRoomIndex(&RoomInfo[i], &IndexRooms[i], NULL);
+		if( roomSize < 0 ) {
+			SIDX_Cleanup();
+			return;
+		}
+		size += roomSize;
+	}
+	IndexPool = (int *)malloc(sizeof(int) * size);
+	if( IndexPool == NULL ) {
+		SIDX_Cleanup();
+		return;
+	}
+	for( i = 0; i < RoomCount; ++i ) {
+		int roomSize = BuildRoomIndex(&RoomInfo[i], &IndexRooms[i], IndexPool + offset);
+		if( roomSize < 0 ) {
+			SIDX_Cleanup();
+			return;
+		}
+		offset += roomSize;
+	}
+	IndexRoomsCount = RoomCount;
+}
+
+void SIDX_Cleanup() {
+	if( IndexRooms != NULL ) {
+		free(IndexRooms);
+		IndexRooms = NULL;
+	}
+	if( IndexPool != NULL ) {
+		free(IndexPool);
+		IndexPool = NULL;
+	}
+	IndexRoomsCount = 0;
+}
+
+/*
+ * Returns the number of the first room static colliding with the box, so
+ * CollideStaticObjects may start its loop from it. If there is no colliding
+ * static, the room statics number is returned. If the room is not indexed,
+ * zero is returned to check all statics as usual.
+ */
+int SIDX_FirstCollision(int roomNumber, int xMin, int xMax, int yMin, int yMax, int zMin, int zMax) {
+	STATIC_INDEX_ROOM *index = FindRoomIndex(roomNumber);
+	int query[6] = {xMin, xMax, yMin, yMax, zMin, zMax};
+	int cx, cz, cxMax, czMin, czMax, k;
+	int result;
+
+	if( index == NULL ) return 0;
+	result = index->numMeshes;
+	cxMax = GetCell(xMax, index->x, index->gridX);
+	czMin = GetCell(zMin, index->z, index->gridZ);
+	czMax = GetCell(zMax, index->z, index->gridZ);
+	for( cx = GetCell(xMin, index->x, index->gridX); cx <= cxMax; ++cx ) {
+		for( cz = czMin; cz <= czMax; ++cz ) {
+			int cell = cx * index->gridZ + cz;
+#ifdef FEATURE_SIMD_RENDER
+			if( GetSimdLevel() >= SIMD_SSE2 ) {
+				k = ScanCellSSE2(index, index->cellStart[cell], index->cellStart[cell + 1], query);
+			} else {
+				k = ScanCell(index, index->cellStart[cell], index->cellStart[cell + 1], query);
+			}
+#else // FEATURE_SIMD_RENDER
+			k = ScanCell(index, index->cellStart[cell], index->cellStart[cell + 1], query);
+#endif // FEATURE_SIMD_RENDER
+			// the cell lists are sorted, so the first hit is the least one
+			if( k >= 0 && index->meshIndex[k] < result ) {
+				result = index->meshIndex[k];
+			}
+		}
+	}
+	return result;
+}
+#endif // FEATURE_ENGINE_IMPROVED
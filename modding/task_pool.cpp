@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/task_pool.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_LOADING_IMPROVED
+#define TASK_MAX_THREADS	(4)
+#define TASK_MAX_QUEUE		(64)
+
+typedef struct TaskEntry_t {
+	TASK_PROC proc;
+	LPVOID param;
+} TASK_ENTRY;
+
+static HANDLE TaskThreads[TASK_MAX_THREADS];
+static int TaskThreadsCount = -1; // the workers are created on the first task
+static CRITICAL_SECTION TaskLock;
+static HANDLE TaskQueueSemaphore = NULL; // counts the queued tasks
+static HANDLE TaskIdleEvent = NULL; // set when there are no pending tasks
+static TASK_ENTRY TaskQueue[TASK_MAX_QUEUE];
+static int TaskQueueHead = 0;
+static int TaskQueueCount = 0;
+static int TaskPendingCount = 0; // queued and running tasks
+static bool TaskExit = false;
+
+static DWORD WINAPI TaskWorkerProc(LPVOID) {
+	TASK_ENTRY task;
+
+	for(;;) {
+		WaitForSingleObject(TaskQueueSemaphore, INFINITE);
+		if( TaskExit ) break;
+
+		EnterCriticalSection(&TaskLock);
+		task = TaskQueue[TaskQueueHead];
+		TaskQueueHead = (TaskQueueHead + 1) % TASK_MAX_QUEUE;
+		--TaskQueueCount;
+		LeaveCriticalSection(&TaskLock);
+
+		task.proc(task.param);
+
+		EnterCriticalSection(&TaskLock);
+		if( --TaskPendingCount == 0 ) {
+			SetEvent(TaskIdleEvent);
+		}
+		LeaveCriticalSection(&TaskLock);
+	}
+	return 0;
+}
+
+static int InitWorkers() {
+	SYSTEM_INFO sysInfo;
+
+	GetSystemInfo(&sysInfo);
+	// the main thread keeps loading the level, so leave one core for it
+	int threadsCount = MIN((int)sysInfo.dwNumberOfProcessors - 1, TASK_MAX_THREADS);
+
+	TaskThreadsCount = 0;
+	if( threadsCount <= 0 ) return 0;
+
+	TaskQueueSemaphore = CreateSemaphore(NULL, 0, TASK_MAX_QUEUE, NULL);
+	TaskIdleEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if( TaskQueueSemaphore == NULL || TaskIdleEvent == NULL ) {
+		if( TaskQueueSemaphore != NULL ) CloseHandle(TaskQueueSemaphore);
+		if( TaskIdleEvent != NULL ) CloseHandle(TaskIdleEvent);
+		TaskQueueSemaphore = NULL;
+		TaskIdleEvent = NULL;
+		return 0;
+	}
+	InitializeCriticalSection(&TaskLock);
+
+	TaskExit = false;
+	for( int i = 0; i < threadsCount; ++i ) {
+		TaskThreads[TaskThreadsCount] = CreateThread(NULL, 0, TaskWorkerProc, NULL, 0, NULL);
+		if( TaskThreads[TaskThreadsCount] == NULL ) break;
+		++TaskThreadsCount;
+	}
+	return TaskThreadsCount;
+}
+
+/*
+ * Queues the task to the worker threads. If there are no workers or the
+ * queue is full, the task is run by the calling thread right away, so the
+ * caller must not rely on the task being asynchronous.
+ */
+void TASK_Run(TASK_PROC proc, LPVOID param) {
+	bool isQueued = false;
+
+	if( TaskThreadsCount < 0 ) InitWorkers();
+	if( TaskThreadsCount > 0 ) {
+		EnterCriticalSection(&TaskLock);
+		if( TaskQueueCount < TASK_MAX_QUEUE ) {
+			TaskQueue[(TaskQueueHead + TaskQueueCount) % TASK_MAX_QUEUE].proc = proc;
+			TaskQueue[(TaskQueueHead + TaskQueueCount) % TASK_MAX_QUEUE].param = param;
+			++TaskQueueCount;
+			if( TaskPendingCount++ == 0 ) {
+				ResetEvent(TaskIdleEvent);
+			}
+			isQueued = true;
+		}
+		LeaveCriticalSection(&TaskLock);
+	}
+	if( isQueued ) {
+		ReleaseSemaphore(TaskQueueSemaphore, 1, NULL);
+	} else {
+		proc(param);
+	}
+}
+
+void TASK_WaitAll() {
+	if( TaskThreadsCount > 0 ) {
+		WaitForSingleObject(TaskIdleEvent, INFINITE);
+	}
+}
+
+void TASK_Cleanup() {
+	if( TaskThreadsCount > 0 ) {
+		TASK_WaitAll();
+		TaskExit = true;
+		ReleaseSemaphore(TaskQueueSemaphore, TaskThreadsCount, NULL);
+		for( int i = 0; i < TaskThreadsCount; ++i ) {
+			WaitForSingleObject(TaskThreads[i], INFINITE);
+			CloseHandle(TaskThreads[i]);
+		}
+		CloseHandle(TaskQueueSemaphore);
+		CloseHandle(TaskIdleEvent);
+		DeleteCriticalSection(&TaskLock);
+		TaskQueueSemaphore = NULL;
+		TaskIdleEvent = NULL;
+	}
+	TaskThreadsCount = -1;
+	TaskQueueHead = 0;
+	TaskQueueCount = 0;
+	TaskPendingCount = 0;
+}
+#endif // FEATURE_LOADING_IMPROVED
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2017-2021 Michael Chaban. All rights reserved.
+ * Original game is written by Core Design Ltd. in 1997.
+ * Lara Croft and Tomb Raider are trademarks of Square Enix Ltd.
+ *
+ * This file is part of TR2Main.
+ *
+ * TR2Main is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Main is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Main.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global/precompiled.h"
+#include "modding/vertex_grid.h"
+#include "modding/light_cluster.h"
+#include "global/vars.h"
+
+#ifdef FEATURE_RENDER_IMPROVED
+/*
+ * The room vertices are binned by the room sectors at level load, so a
+ * dynamic light visits only the sectors within its radius. The vertices on
+ * the far room border get their own row of cells. Each vertex is changed
+ * by the lights in the same order as before, so the result is the same.
+ *
+ * The static lit rooms are restored to the base light after the dynamic
+ * lights. The first restore is done for the whole room as before, since the
+ * level file light may differ from the base one. After that only the
+ * vertices changed by the dynamic lights are restored.
+ */
+typedef struct VertexGrid_t {
+	__int16 *roomData; // the room data identity
+	__int16 pair; // the flipmap pair slot
+	int cellsX;
+	int cellsZ;
+	int *cellStart;
+	UINT16 *vertices;
+	UINT16 *dirty;
+	BYTE *dirtyMarks;
+	int dirtyCount;
+	bool isRestored;
+} VERTEX_GRID;
+
+static VERTEX_GRID *Grids = NULL;
+static int GridsCount = 0;
+
+static int GetCellX(VERTEX_GRID *grid, int x) {
+	int cx = x >> WALL_SHIFT;
+	CLAMP(cx, 0, grid->cellsX - 1);
+	return cx;
+}
+
+static int GetCellZ(VERTEX_GRID *grid, int z) {
+	int cz = z >> WALL_SHIFT;
+	CLAMP(cz, 0, grid->cellsZ - 1);
+	return cz;
+}
+
+static bool BuildGrid(ROOM_INFO *room, VERTEX_GRID *grid) {
+	int i, cell, cellsCount;
+	int vtxCount = *room->data;
+	ROOM_VERTEX_INFO *roomVtx = (ROOM_VERTEX_INFO *)(room->data + 1);
+
+	grid->cellsX = room->ySize + 1;
+	grid->cellsZ = room->xSize + 1;
+	cellsCount = grid->cellsX * grid->cellsZ;
+	grid->cellStart = (int *)calloc(cellsCount + 1, sizeof(int));
+	grid->vertices = (UINT16 *)malloc(sizeof(UINT16) * vtxCount);
+	grid->dirty = (UINT16 *)malloc(sizeof(UINT16) * vtxCount);
+	grid->dirtyMarks = (BYTE *)calloc(vtxCount, sizeof(BYTE));
+	if( grid->cellStart == NULL || grid->vertices == NULL || grid->dirty == NULL || grid->dirtyMarks == NULL ) {
+		return false;
+	}
+
+	for( i = 0; i < vtxCount; ++i ) {
+		cell = GetCellX(grid, roomVtx[i].x) * grid->cellsZ + GetCellZ(grid, roomVtx[i].z);
+		++grid->cellStart[cell + 1];
+	}
+	for( cell = 0; cell < cellsCount; ++cell ) {
+		grid->cellStart[cell + 1] += grid->cellStart[cell];
+	}
+	// the cell starts are moved to the cell ends while filling
+	for( i = 0; i < vtxCount; ++i ) {
+		cell = GetCellX(grid, roomVtx[i].x) * grid->cellsZ + GetCellZ(grid, roomVtx[i].z);
+		grid->vertices[grid->cellStart[cell]++] = i;
+	}
+	for( cell = cellsCount; cell > 0; --cell ) {
+		grid->cellStart[cell] = grid->cellStart[cell - 1];
+	}
+	grid->cellStart[0] = 0;
+	return true;
+}
+
+static void FreeGrid(VERTEX_GRID *grid) {
+	if( grid->cellStart != NULL ) free(grid->cellStart);
+	if( grid->vertices != NULL ) free(grid->vertices);
+	if( grid->dirty != NULL ) free(grid->dirty);
+	if( grid->dirtyMarks != NULL ) free(grid->dirtyMarks);
+	grid->cellStart = NULL;
+	grid->vertices = NULL;
+	grid->dirty = NULL;
+	grid->dirtyMarks = NULL;
+}
+
+static VERTEX_GRID *GetGrid(ROOM_INFO *room) {
+	int roomNumber = room - RoomInfo;
+	if( Grids == NULL || roomNumber < 0 || roomNumber >= GridsCount ) return NULL;
+	VERTEX_GRID *grid = &Grids[roomNumber];
+	if( grid->roomData != room->data ) {
+		// the flipmap has swapped the room data
+		if( grid->pair < 0 ) return NULL;
+		grid = &Grids[grid->pair];
+		if( grid->roomData != room->data ) return NULL;
+	}
+	return ( grid->cellStart != NULL ) ? grid : NULL;
+}
+
+void VGRID_LevelInit() {
+	int i;
+
+	VGRID_Cleanup();
+	if( RoomCount <= 0 ) return;
+
+	Grids = (VERTEX_GRID *)calloc(RoomCount, sizeof(VERTEX_GRID));
+	if( Grids == NULL ) return;
+	GridsCount = RoomCount;
+
+	for( i = 0; i < RoomCount; ++i ) {
+		ROOM_INFO *room = &RoomInfo[i];
+		VERTEX_GRID *grid = &Grids[i];
+		grid->roomData = room->data;
+		grid->pair = -1;
+		if( room->data == NULL || *room->data <= 0 || room->xSize <= 0 || room->ySize <= 0 ) continue;
+		if( !BuildGrid(room, grid) ) {
+			FreeGrid(grid);
+		}
+	}
+	// the flipmap pair is the same in both flip states
+	for( i = 0; i < RoomCount; ++i ) {
+		__int16 flipped = RoomInfo[i].flippedRoom;
+		if( flipped >= 0 && flipped < RoomCount ) {
+			Grids[i].pair = flipped;
+			Grids[flipped].pair = i;
+		}
+	}
+}
+
+void VGRID_Cleanup() {
+	if( Grids != NULL ) {
+		for( int i = 0; i < GridsCount; ++i ) {
+			FreeGrid(&Grids[i]);
+		}
+		free(Grids);
+		Grids = NULL;
+	}
+	GridsCount = 0;
+}
+
+/*
+ * Restores the base light of the vertices changed by the dynamic lights.
+ * Returns false if the caller must restore the whole room.
+ */
+bool VGRID_RestoreRoom(ROOM_INFO *room) {
+	VERTEX_GRID *grid = GetGrid(room);
+	if( grid == NULL ) return false;
+
+	ROOM_VERTEX_INFO *roomVtx = (ROOM_VERTEX_INFO *)(room->data + 1);
+	bool result = grid->isRestored;
+	for( int i = 0; i < grid->dirtyCount; ++i ) {
+		int j = grid->dirty[i];
+		if( result ) {
+			roomVtx[j].lightAdder = roomVtx[j].lightBase;
+		}
+		grid->dirtyMarks[j] = 0;
+	}
+	grid->dirtyCount = 0;
+	grid->isRestored = true;
+	return result;
+}
+
+/*
+ * The same dynamic light calculation as S_LightRoom does, but only for the
+ * room sectors within the light radius. Returns false if the room has no
+ * vertex grid.
+ */
+bool VGRID_LightRoom(ROOM_INFO *room) {
+	int shade, falloff, intensity;
+	int xPos, yPos, zPos;
+	int xDist, yDist, zDist, distance, radius;
+	int cx, cz, cxMin, cxMax, czMin, czMax, k;
+	ROOM_VERTEX_INFO *roomVtx;
+	VERTEX_GRID *grid = GetGrid(room);
+	if( grid == NULL ) return false;
+
+	// the other rooms are restored every frame, so nothing is tracked there
+	bool isTracked = ( room->lightMode == 0 );
+	roomVtx = (ROOM_VERTEX_INFO *)(room->data + 1);
+
+	int xMin = 0x400;
+	int zMin = 0x400;
+	int xMax = 0x400 * (room->ySize - 1);
+	int zMax = 0x400 * (room->xSize - 1);
+
+	int dynamicCount = DynamicLightCount;
+	UINT16 *dynamicLights = LCLUST_GetRoomLights(room - RoomInfo, &dynamicCount);
+	for( int n = 0; n < dynamicCount; ++n ) {
+		int i = ( dynamicLights != NULL ) ? dynamicLights[n] : n;
+		xPos = DynamicLights[i].x - room->x;
+		yPos = DynamicLights[i].y;
+		zPos = DynamicLights[i].z - room->z;
+		falloff = DynamicLights[i].fallOff1;
+		intensity = DynamicLights[i].intensity1;
+
+		radius = 1 << falloff;
+
+		if( xPos + radius < xMin || zPos + radius < zMin || xPos - radius > xMax || zPos - radius > zMax ) {
+			continue;
+		}
+		room->flags |= 0x10;
+		cxMin = GetCellX(grid, xPos - radius);
+		cxMax = GetCellX(grid, xPos + radius);
+		czMin = GetCellZ(grid, zPos - radius);
+		czMax = GetCellZ(grid, zPos + radius);
+		for( cx = cxMin; cx <= cxMax; ++cx ) {
+			int *cellStart = &grid->cellStart[cx * grid->cellsZ];
+			for( k = cellStart[czMin]; k < cellStart[czMax + 1]; ++k ) {
+				int j = grid->vertices[k];
+				if( roomVtx[j].lightAdder == 0 ) continue;
+				xDist = roomVtx[j].x - xPos;
+				yDist = roomVtx[j].y - yPos;
+				zDist = roomVtx[j].z - zPos;
+				if( (xDist >= -radius && xDist <= radius) &&
+					(yDist >= -radius && yDist <= radius) &&
+					(zDist >= -radius && zDist <= radius) )
+				{
+					distance = SQR(xDist) + SQR(yDist) + SQR(zDist);
+					if( distance <= SQR(radius) ) {
+						shade = (1 << intensity) - (distance >> (2 * falloff - intensity));
+						roomVtx[j].lightAdder -= shade;
+						if( roomVtx[j].lightAdder < 0 )
+							roomVtx[j].lightAdder = 0;
+						if( isTracked && !grid->dirtyMarks[j] ) {
+							grid->dirtyMarks[j] = 1;
+							grid->dirty[grid->dirtyCount++] = j;
+						}
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+#endif // FEATURE_RENDER_IMPROVED
@@ -47,6 +47,25 @@
 extern bool IsGold();
 #endif
 
+#ifdef FEATURE_EXTENDED_LIMITS
+#include "3dsystem/3d_arena.h"
+#endif // FEATURE_EXTENDED_LIMITS
+
+#ifdef FEATURE_RENDER_IMPROVED
+#include "3dsystem/3d_cull.h"
+#include "modding/light_cluster.h"
+#include "modding/light_probe.h"
+#include "modding/room_pvs.h"
+#include "modding/vertex_grid.h"
+#endif // FEATURE_RENDER_IMPROVED
+
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/box_zones.h"
+#include "modding/floor_cache.h"
+#include "modding/room_grid.h"
+#include "modding/static_index.h"
+#endif // FEATURE_ENGINE_IMPROVED
+
 #ifdef FEATURE_BACKGROUND_IMPROVED
 #include "modding/background_new.h"
 
@@ -61,6 +80,256 @@ extern bool LoadingScreensEnabled;
 #include "modding/texture_utils.h"
 #endif // FEATURE_HUD_IMPROVED
 
+#ifdef FEATURE_LOADING_IMPROVED
+#include "modding/sample_bank.h"
+#include "modding/task_pool.h"
+
+// The level file is mapped (or read at once), and the loaders parse its image
+// by the cursor instead of thousands of small file reads. Some arrays point
+// straight into the image, so it's kept until the next level is loaded.
+static HANDLE LevelImageFile = INVALID_HANDLE_VALUE;
+static BYTE *LevelImage = NULL;
+static DWORD LevelImageSize = 0;
+static DWORD LevelImagePos = 0;
+static bool IsLevelImageMapped = false;
+
+// The next level file may be read by the worker in advance (see S_PrefetchLevelFile)
+static char PrefetchFileName[256] = "";
+static BYTE *PrefetchImage = NULL;
+static DWORD PrefetchImageSize = 0;
+static bool IsPrefetchQueued = false;
+
+static void FreeLevelImage() {
+	if( LevelImage != NULL ) {
+		if( IsLevelImageMapped ) {
+			UnmapViewOfFile(LevelImage);
+		} else {
+			VirtualFree(LevelImage, 0, MEM_RELEASE);
+		}
+	}
+	LevelImageFile = INVALID_HANDLE_VALUE;
+	LevelImage = NULL;
+	LevelImageSize = 0;
+	LevelImagePos = 0;
+	IsLevelImageMapped = false;
+}
+
+static void PrefetchLevelTask(LPVOID param) {
+	HANDLE hFile;
+	DWORD bytesRead = 0;
+
+	hFile = CreateFile(PrefetchFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN|FILE_ATTRIBUTE_NORMAL, NULL);
+	if( hFile == INVALID_HANDLE_VALUE ) {
+		return;
+	}
+	PrefetchImageSize = GetFileSize(hFile, NULL);
+	if( PrefetchImageSize != INVALID_FILE_SIZE && PrefetchImageSize != 0 ) {
+		PrefetchImage = (BYTE *)VirtualAlloc(NULL, PrefetchImageSize, MEM_COMMIT, PAGE_READWRITE);
+	}
+	if( PrefetchImage != NULL ) {
+		if( !ReadFile(hFile, PrefetchImage, PrefetchImageSize, &bytesRead, NULL) || bytesRead != PrefetchImageSize ) {
+			VirtualFree(PrefetchImage, 0, MEM_RELEASE);
+			PrefetchImage = NULL;
+		}
+	}
+	CloseHandle(hFile);
+}
+
+static void WaitLevelPrefetch() {
+	if( IsPrefetchQueued ) {
+		TASK_WaitAll();
+		IsPrefetchQueued = false;
+	}
+}
+
+static void DropLevelPrefetch() {
+	WaitLevelPrefetch();
+	if( PrefetchImage != NULL ) {
+		VirtualFree(PrefetchImage, 0, MEM_RELEASE);
+		PrefetchImage = NULL;
+	}
+	PrefetchImageSize = 0;
+	*PrefetchFileName = 0;
+}
+
+static bool AdoptLevelPrefetch(LPCTSTR fileName, DWORD fileSize) {
+	WaitLevelPrefetch();
+	if( PrefetchImage == NULL || PrefetchImageSize != fileSize || lstrcmpi(PrefetchFileName, fileName) ) {
+		DropLevelPrefetch();
+		return false;
+	}
+	LevelImage = PrefetchImage;
+	PrefetchImage = NULL;
+	DropLevelPrefetch();
+	return true;
+}
+
+static bool OpenLevelImage(HANDLE hFile) {
+	HANDLE hMapping;
+	DWORD bytesRead = 0;
+	DWORD fileSize = GetFileSize(hFile, NULL);
+
+	FreeLevelImage();
+	if( fileSize == INVALID_FILE_SIZE || fileSize == 0 ) {
+		DropLevelPrefetch();
+		return false;
+	}
+
+	// The prefetched image is taken as is, the file is not read at all
+	if( AdoptLevelPrefetch(LevelFileName, fileSize) ) {
+		LevelImageFile = hFile;
+		LevelImageSize = fileSize;
+		LevelImagePos = 0;
+		return true;
+	}
+
+	// Copy-on-write view, so the arrays pointing into the image may be changed
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if( hMapping != NULL ) {
+		LevelImage = (BYTE *)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(hMapping); // the view keeps the mapping alive
+		IsLevelImageMapped = ( LevelImage != NULL );
+	}
+	if( LevelImage == NULL ) {
+		// The file can't be mapped, so read it with a single call
+		LevelImage = (BYTE *)VirtualAlloc(NULL, fileSize, MEM_COMMIT, PAGE_READWRITE);
+		if( LevelImage == NULL ) {
+			return false;
+		}
+		if( !ReadFile(hFile, LevelImage, fileSize, &bytesRead, NULL) || bytesRead != fileSize ) {
+			FreeLevelImage();
+			SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+			return false;
+		}
+	}
+	LevelImageFile = hFile;
+	LevelImageSize = fileSize;
+	LevelImagePos = 0;
+	return true;
+}
+
+static void CloseLevelImage() {
+	// the image itself stays alive for the arrays pointing into it
+	LevelImageFile = INVALID_HANDLE_VALUE;
+}
+
+// Returns the pointer to the next level image bytes and skips them
+static LPVOID GetLevelImageData(HANDLE hFile, DWORD size) {
+	LPVOID result;
+
+	if( hFile != LevelImageFile || size > LevelImageSize - LevelImagePos ) {
+		return NULL;
+	}
+	result = &LevelImage[LevelImagePos];
+	LevelImagePos += size;
+	return result;
+}
+
+static DWORD LevelFileSeek(HANDLE hFile, LONG distance, PLONG distanceHigh, DWORD moveMethod) {
+	LONG pos;
+
+	if( hFile != LevelImageFile ) {
+		return SetFilePointer(hFile, distance, distanceHigh, moveMethod);
+	}
+	switch( moveMethod ) {
+	case FILE_BEGIN :
+		pos = distance;
+		break;
+	case FILE_END :
+		pos = LevelImageSize + distance;
+		break;
+	default :
+		pos = LevelImagePos + distance;
+		break;
+	}
+	CLAMP(pos, 0, (LONG)LevelImageSize);
+	LevelImagePos = pos;
+	if( distanceHigh != NULL ) {
+		*distanceHigh = 0;
+	}
+	return LevelImagePos;
+}
+
+/*
+ * Starts reading the level file by the worker thread, so the next LoadLevel
+ * call for this file gets its image without waiting for the disk
+ */
+void S_PrefetchLevelFile(LPCTSTR fileName) {
+	DropLevelPrefetch();
+	lstrcpyn(PrefetchFileName, GetFullPath(fileName), sizeof(PrefetchFileName));
+	IsPrefetchQueued = true;
+	TASK_Run(PrefetchLevelTask, NULL);
+}
+
+// Allocates the array and reads it, or points it straight into the level image
+static LPVOID LoadLevelArray(HANDLE hFile, DWORD size, DWORD bufIndex, LPDWORD lpBytesRead) {
+	LPVOID result = GetLevelImageData(hFile, size);
+
+	if( result == NULL ) {
+		result = game_malloc(size, bufIndex);
+		ReadFileSync(hFile, result, size, lpBytesRead, NULL);
+	} else {
+		*lpBytesRead = size;
+	}
+	return result;
+}
+
+#ifdef FEATURE_RENDER_IMPROVED
+// These passes use only the rooms and meshes, so they are run by the workers
+// while the main thread keeps loading the rest of the level
+static void CullLevelInitTask(LPVOID param) {
+	CULL_LevelInit(MeshPtr, (DWORD)param);
+}
+
+static void PvsLevelInitTask(LPVOID) {
+	PVS_LevelInit();
+}
+
+// The face planes and the PVS depend on the level file only, so they are kept
+// after the level is unloaded. If the same file is loaded again (e.g. after
+// Lara's death or a savegame load), the PVS is taken as is, and the face
+// planes are just moved to the new level image address. The other loading
+// passes (object remap, texture UVs, semitransparency, depth and gouraud
+// tables) fill the original globals, so they are still run for every load.
+static char SnapshotFileName[256] = "";
+static DWORD SnapshotFileSize = 0;
+static FILETIME SnapshotWriteTime;
+static BYTE *SnapshotImage = NULL; // the previous image address, it's not valid memory anymore
+static DWORD SnapshotImageSize = 0;
+static bool IsLevelReload = false;
+
+static void DropLevelSnapshot() {
+	*SnapshotFileName = 0;
+	SnapshotFileSize = 0;
+	SnapshotImage = NULL;
+	SnapshotImageSize = 0;
+}
+
+static void TakeLevelSnapshot(HANDLE hFile) {
+	DropLevelSnapshot();
+	if( LevelImage == NULL || !GetFileTime(hFile, NULL, NULL, &SnapshotWriteTime) ) {
+		return;
+	}
+	lstrcpyn(SnapshotFileName, LevelFileName, sizeof(SnapshotFileName));
+	SnapshotFileSize = GetFileSize(hFile, NULL);
+	SnapshotImage = LevelImage;
+	SnapshotImageSize = LevelImageSize;
+}
+
+static void CheckLevelReload(HANDLE hFile) {
+	FILETIME writeTime;
+
+	IsLevelReload = ( SnapshotImage != NULL &&
+		GetFileSize(hFile, NULL) == SnapshotFileSize &&
+		GetFileTime(hFile, NULL, NULL, &writeTime) &&
+		!CompareFileTime(&writeTime, &SnapshotWriteTime) &&
+		!lstrcmpi(LevelFileName, SnapshotFileName) );
+}
+#endif // FEATURE_RENDER_IMPROVED
+#else // FEATURE_LOADING_IMPROVED
+#define LevelFileSeek SetFilePointer
+#endif // FEATURE_LOADING_IMPROVED
+
 #ifdef FEATURE_VIDEOFX_IMPROVED
 static bool MarkSemitransPoly(__int16 *ptrObj, int vtxCount, bool colored, LPVOID param) {
 	UINT16 index = ptrObj[vtxCount];
@@ -233,6 +502,10 @@ static void LoadBareFootSFX(int *sampleIndexes, int sampleCount) {
 	LPCTSTR sfxFileName = GetFullPath("data\\barefoot.sfx");
 	if( !PathFileExists(sfxFileName) ) return;
 
+#ifdef FEATURE_LOADING_IMPROVED
+	// barefoot.sfx replaces the first samples only, so it's normal that it has fewer ones
+	SFX_LoadSamples(sfxFileName, sampleIndexes, sampleCount);
+#else // FEATURE_LOADING_IMPROVED
 	HANDLE hSfxFile = CreateFile(sfxFileName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 	if( hSfxFile == INVALID_HANDLE_VALUE ) return;
 
@@ -264,14 +537,15 @@ static void LoadBareFootSFX(int *sampleIndexes, int sampleCount) {
 			SetFilePointer(hSfxFile, dataSize, NULL, FILE_CURRENT);
 		}
 	}
-	for( i=0; i<4; ++i ) { // there are no more than 4 barefoot step samples
+	CloseHandle(hSfxFile);
+#endif // FEATURE_LOADING_IMPROVED
+	for( int i=0; i<4; ++i ) { // there are no more than 4 barefoot step samples
 		if( SampleInfos[i].sfxID >= 4 ) break;
 		// SFX parameters are taken from the PlayStation version
 		SampleInfos[i].volume = 0x3332;
 		SampleInfos[i].randomness = 0;
 		SampleInfos[i].flags = 0x6010;
 	}
-	CloseHandle(hSfxFile);
 }
 #endif // FEATURE_MOD_CONFIG
 
@@ -350,7 +624,7 @@ static int CreateBgndPatternTexture(HANDLE hFile) {
 
 	DWORD bytesRead;
 	int pageCount = 0;
-	SetFilePointer(hFile, LevelFileTexPagesOffset, NULL, FILE_BEGIN);
+	LevelFileSeek(hFile, LevelFileTexPagesOffset, NULL, FILE_BEGIN);
 	ReadFileSync(hFile, &pageCount, sizeof(pageCount), &bytesRead, NULL);
 	if( BgndPattern.page >= pageCount ) {
 		return -1;
@@ -365,12 +639,12 @@ static int CreateBgndPatternTexture(HANDLE hFile) {
 	DWORD pageSize = ( TextureFormat.bpp < 16 ) ? 256*256*1 : 256*256*2;
 	BYTE *bitmap = (BYTE *)GlobalAlloc(GMEM_FIXED, pageSize);
 	if( TextureFormat.bpp < 16 ) {
-		SetFilePointer(hFile, BgndPattern.page*(256*256*1), NULL, FILE_CURRENT);
+		LevelFileSeek(hFile, BgndPattern.page*(256*256*1), NULL, FILE_CURRENT);
 		ReadFileSync(hFile, bitmap, pageSize, &bytesRead, NULL);
 		pageIndex = MakeCustomTexture(BgndPattern.x, BgndPattern.y, BgndPattern.side, BgndPattern.side,
 									256, BgndPattern.side, 8, bitmap, GamePalette8, PaletteIndex, NULL, false);
 	} else {
-		SetFilePointer(hFile, pageCount*(256*256*1) + BgndPattern.page*(256*256*2), NULL, FILE_CURRENT);
+		LevelFileSeek(hFile, pageCount*(256*256*1) + BgndPattern.page*(256*256*2), NULL, FILE_CURRENT);
 		ReadFileSync(hFile, bitmap, pageSize, &bytesRead, NULL);
 		pageIndex = MakeCustomTexture(BgndPattern.x, BgndPattern.y, BgndPattern.side, BgndPattern.side,
 									256, BgndPattern.side, 16, bitmap, NULL, -1, NULL, false);
@@ -396,6 +670,17 @@ BOOL __cdecl ReadFileSync(HANDLE hFile, LPVOID lpBuffer, DWORD nBytesToRead, LPD
 		ReadFileBytesCounter = 0;
 		WinVidSpinMessageLoop(false);
 	}
+#ifdef FEATURE_LOADING_IMPROVED
+	if( hFile == LevelImageFile ) {
+		DWORD bytesToCopy = MIN(nBytesToRead, LevelImageSize - LevelImagePos);
+		memcpy(lpBuffer, &LevelImage[LevelImagePos], bytesToCopy);
+		LevelImagePos += bytesToCopy;
+		if( lpnBytesRead != NULL ) {
+			*lpnBytesRead = bytesToCopy;
+		}
+		return TRUE;
+	}
+#endif // FEATURE_LOADING_IMPROVED
 	return ReadFile(hFile, lpBuffer, nBytesToRead, lpnBytesRead, lpOverlapped);
 }
 
@@ -416,7 +701,7 @@ BOOL __cdecl LoadTexturePages(HANDLE hFile) {
 			}
 			ReadFileSync(hFile, TexturePageBuffer8[i], 256*256*1, &bytesRead, NULL);
 		}
-		SetFilePointer(hFile, pageCount*(256*256*2), NULL, FILE_CURRENT);
+		LevelFileSeek(hFile, pageCount*(256*256*2), NULL, FILE_CURRENT);
 	} else {
 		// for hardware renderer do BPP check and load 8 bit or 16 bit texture pages to GLOBAL allocated memory and skip others
 		pageSize = ( TextureFormat.bpp < 16 ) ? 256*256*1 : 256*256*2;
@@ -433,11 +718,11 @@ BOOL __cdecl LoadTexturePages(HANDLE hFile) {
 				ReadFileSync(hFile, texPagePtr, pageSize, &bytesRead, NULL);
 				texPagePtr += pageSize;
 			}
-			SetFilePointer(hFile, pageCount*(256*256*2), NULL, FILE_CURRENT);
+			LevelFileSeek(hFile, pageCount*(256*256*2), NULL, FILE_CURRENT);
 			HWR_LoadTexturePages(pageCount, texPageBuffer, GamePalette8);
 		} else {
 			// skip 8 bit texture pages and load 16 bit texture pages
-			SetFilePointer(hFile, pageCount*(256*256*1), NULL, FILE_CURRENT);
+			LevelFileSeek(hFile, pageCount*(256*256*1), NULL, FILE_CURRENT);
 			for( i=0; i<pageCount; ++i ) {
 				ReadFileSync(hFile, texPagePtr, pageSize, &bytesRead, NULL);
 				texPagePtr += pageSize;
@@ -489,8 +774,12 @@ BOOL __cdecl LoadRooms(HANDLE hFile) {
 
 		// Room mesh
 		ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+		RoomInfo[i].data = (__int16 *)LoadLevelArray(hFile, sizeof(__int16)*dwCount, GBUF_RoomMesh, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 		RoomInfo[i].data = (__int16 *)game_malloc(sizeof(__int16)*dwCount, GBUF_RoomMesh);
 		ReadFileSync(hFile, RoomInfo[i].data, sizeof(__int16)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 		// Doors
 		ReadFileSync(hFile, &wCount, sizeof(__int16), &bytesRead, NULL);
@@ -506,8 +795,12 @@ BOOL __cdecl LoadRooms(HANDLE hFile) {
 		ReadFileSync(hFile, &RoomInfo[i].xSize, sizeof(__int16), &bytesRead, NULL);
 		ReadFileSync(hFile, &RoomInfo[i].ySize, sizeof(__int16), &bytesRead, NULL);
 		dwCount = RoomInfo[i].xSize * RoomInfo[i].ySize;
+#ifdef FEATURE_LOADING_IMPROVED
+		RoomInfo[i].floor = (FLOOR_INFO *)LoadLevelArray(hFile, sizeof(FLOOR_INFO)*dwCount, GBUF_RoomFloor, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 		RoomInfo[i].floor = (FLOOR_INFO *)game_malloc(sizeof(FLOOR_INFO)*dwCount, GBUF_RoomFloor);
 		ReadFileSync(hFile, RoomInfo[i].floor, sizeof(FLOOR_INFO)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 		// Room lights
 		ReadFileSync(hFile, &RoomInfo[i].ambient1, sizeof(__int16), &bytesRead, NULL);
@@ -548,8 +841,15 @@ BOOL __cdecl LoadRooms(HANDLE hFile) {
 
 	// Read floor data
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	FloorData = (__int16 *)LoadLevelArray(hFile, sizeof(__int16)*dwCount, GBUF_FloorData, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	FloorData = (__int16 *)game_malloc(sizeof(__int16)*dwCount, GBUF_FloorData);
 	ReadFileSync(hFile, FloorData, sizeof(__int16)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
+#ifdef FEATURE_ENGINE_IMPROVED
+	FCACHE_LevelInit(dwCount);
+#endif // FEATURE_ENGINE_IMPROVED
 	return TRUE;
 }
 
@@ -624,8 +924,12 @@ BOOL __cdecl LoadObjects(HANDLE hFile) {
 
 	// Load mesh base data
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	Meshes = (__int16 *)LoadLevelArray(hFile, sizeof(__int16)*dwCount, GBUF_Meshes, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	Meshes = (__int16 *)game_malloc(sizeof(__int16)*dwCount, GBUF_Meshes);
 	ReadFileSync(hFile, Meshes, sizeof(__int16)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Load mesh pointers
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
@@ -635,6 +939,16 @@ BOOL __cdecl LoadObjects(HANDLE hFile) {
 	// Remap mesh pointers
 	for( i = 0; i < dwCount; ++i )
 		MeshPtr[i] = (__int16 *)((DWORD)Meshes + (DWORD)MeshPtr[i]);
+#ifdef FEATURE_RENDER_IMPROVED
+	// Rooms are already loaded here, so precalculate face planes for both
+#ifdef FEATURE_LOADING_IMPROVED
+	if( !IsLevelReload || !CULL_LevelRebase(SnapshotImage, SnapshotImageSize, LevelImage) ) {
+		TASK_Run(CullLevelInitTask, (LPVOID)dwCount);
+	}
+#else // FEATURE_LOADING_IMPROVED
+	CULL_LevelInit(MeshPtr, dwCount);
+#endif // FEATURE_LOADING_IMPROVED
+#endif // FEATURE_RENDER_IMPROVED
 
 	// Load anims
 	ReadFileSync(hFile, &animCount, sizeof(DWORD), &bytesRead, NULL);
@@ -643,28 +957,48 @@ BOOL __cdecl LoadObjects(HANDLE hFile) {
 
 	// Load changes
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	AnimChanges = (CHANGE_STRUCT *)LoadLevelArray(hFile, sizeof(CHANGE_STRUCT)*dwCount, GBUF_Structs, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	AnimChanges = (CHANGE_STRUCT *)game_malloc(sizeof(CHANGE_STRUCT)*dwCount, GBUF_Structs);
 	ReadFileSync(hFile, AnimChanges, sizeof(CHANGE_STRUCT)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Load ranges
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	AnimRanges = (RANGE_STRUCT *)LoadLevelArray(hFile, sizeof(RANGE_STRUCT)*dwCount, GBUF_Ranges, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	AnimRanges = (RANGE_STRUCT *)game_malloc(sizeof(RANGE_STRUCT)*dwCount, GBUF_Ranges);
 	ReadFileSync(hFile, AnimRanges, sizeof(RANGE_STRUCT)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Load commands
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	AnimCommands = (__int16 *)LoadLevelArray(hFile, sizeof(__int16)*dwCount, GBUF_Commands, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	AnimCommands = (__int16 *)game_malloc(sizeof(__int16)*dwCount, GBUF_Commands);
 	ReadFileSync(hFile, AnimCommands, sizeof(__int16)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Load bones
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	AnimBones = (int *)LoadLevelArray(hFile, sizeof(int)*dwCount, GBUF_Bones, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	AnimBones = (int *)game_malloc(sizeof(int)*dwCount, GBUF_Bones);
 	ReadFileSync(hFile, AnimBones, sizeof(int)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Load frames
 	ReadFileSync(hFile, &dwCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	AnimFrames = (__int16 *)LoadLevelArray(hFile, sizeof(__int16)*dwCount, GBUF_Frames, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	AnimFrames = (__int16 *)game_malloc(sizeof(__int16)*dwCount, GBUF_Frames);
 	ReadFileSync(hFile, AnimFrames, sizeof(__int16)*dwCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 
 	// Remap anim pointers
 	for( i = 0; i < animCount; ++i )
@@ -746,7 +1080,7 @@ BOOL __cdecl LoadSprites(HANDLE hFile) {
 			Objects[objNumber].loaded = 1;
 		} else {
 			objNumber -= ID_NUMBER_OBJECTS;
-			SetFilePointer(hFile, sizeof(__int16), NULL, FILE_CURRENT); // StaticObjects don't have nMeshes (just one mesh)
+			LevelFileSeek(hFile, sizeof(__int16), NULL, FILE_CURRENT); // StaticObjects don't have nMeshes (just one mesh)
 			ReadFileSync(hFile, &StaticObjects[objNumber].meshIndex, sizeof(__int16), &bytesRead, NULL);
 		}
 	}
@@ -912,8 +1246,12 @@ BOOL __cdecl LoadBoxes(HANDLE hFile) {
 
 	// Load Overlaps
 	ReadFileSync(hFile, &overlapsCount, sizeof(DWORD), &bytesRead, NULL);
+#ifdef FEATURE_LOADING_IMPROVED
+	Overlaps = (UINT16 *)LoadLevelArray(hFile, sizeof(UINT16)*overlapsCount, GBUF_Overlaps, &bytesRead);
+#else // FEATURE_LOADING_IMPROVED
 	Overlaps = (UINT16 *)game_malloc(sizeof(UINT16)*overlapsCount, GBUF_Overlaps);
 	ReadFileSync(hFile, Overlaps, sizeof(UINT16)*overlapsCount, &bytesRead, NULL);
+#endif // FEATURE_LOADING_IMPROVED
 	if( bytesRead != sizeof(UINT16)*overlapsCount ) {
 		lstrcpy(StringToShow, "LoadBoxes(): Unable to load box overlaps");
 		return FALSE;
@@ -926,7 +1264,11 @@ BOOL __cdecl LoadBoxes(HANDLE hFile) {
 				(j == 1 && !Objects[ID_SPIDER_or_WOLF].loaded && !Objects[ID_SKIDOO_ARMED].loaded) ||
 				(j == 3 && !Objects[ID_YETI].loaded && !Objects[ID_WORKER3].loaded) )
 			{
-				SetFilePointer(hFile, sizeof(__int16)*BoxesCount, NULL, FILE_CURRENT); // skip some GroundZones
+				LevelFileSeek(hFile, sizeof(__int16)*BoxesCount, NULL, FILE_CURRENT); // skip some GroundZones
+#ifdef FEATURE_ENGINE_IMPROVED
+				// the pointer of the previous level is not left for the box zone tables
+				GroundZones[j*2+i] = NULL;
+#endif // FEATURE_ENGINE_IMPROVED
 				continue;
 			}
 
@@ -1002,15 +1344,10 @@ void __cdecl LoadDemoExternal(LPCTSTR levelName) {
 }
 
 BOOL __cdecl LoadSamples(HANDLE hFile) {
-	int i, j;
+	int i;
 	DWORD bytesRead;
-	HANDLE hSfxFile;
 	LPCTSTR sfxFileName;
-	DWORD dataSize;
-	LPVOID waveData;
 	int sampleCount;
-	WAVEPCM_HEADER waveHeader;
-	LPWAVEFORMATEX waveFormat;
 	int sampleIndexes[500];
 
 	SoundIsActive = FALSE;
@@ -1048,6 +1385,23 @@ BOOL __cdecl LoadSamples(HANDLE hFile) {
 	}
 #endif // FEATURE_GOLD
 	sfxFileName = GetFullPath(sfxFileName);
+#ifdef FEATURE_LOADING_IMPROVED
+	i = SFX_LoadSamples(sfxFileName, sampleIndexes, sampleCount);
+	if( i < 0 ) {
+		wsprintf(StringToShow, "Could not open MAIN.SFX file");
+		return FALSE;
+	}
+	if( i != sampleCount ) {
+		return FALSE;
+	}
+#else // FEATURE_LOADING_IMPROVED
+	int j;
+	HANDLE hSfxFile;
+	DWORD dataSize;
+	LPVOID waveData;
+	WAVEPCM_HEADER waveHeader;
+	LPWAVEFORMATEX waveFormat;
+
 	hSfxFile = CreateFile(sfxFileName, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 	if( hSfxFile == INVALID_HANDLE_VALUE ) {
 		wsprintf(StringToShow, "Could not open MAIN.SFX file");
@@ -1083,6 +1437,7 @@ BOOL __cdecl LoadSamples(HANDLE hFile) {
 		}
 	}
 	CloseHandle(hSfxFile);
+#endif // FEATURE_LOADING_IMPROVED
 	SoundIsActive = TRUE;
 #if defined(FEATURE_MOD_CONFIG)
 	LoadBareFootSFX(sampleIndexes, sampleCount);
@@ -1150,12 +1505,21 @@ BOOL __cdecl LoadLevel(LPCTSTR fileName, int levelID) {
 	fullPath = GetFullPath(fileName);
 	strcpy(LevelFileName, fullPath);
 	init_game_malloc();
+#ifdef FEATURE_LOADING_IMPROVED
+	WaitLevelPrefetch(); // the worker must close the file first
+#endif // FEATURE_LOADING_IMPROVED
 
 	hFile = CreateFile(fullPath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN|FILE_ATTRIBUTE_NORMAL, NULL);
 	if( hFile == INVALID_HANDLE_VALUE ) {
 		wsprintf(StringToShow, "LoadLevel(): Could not open %s (level %d)", fullPath, levelID);
 		return FALSE;
 	}
+#ifdef FEATURE_LOADING_IMPROVED
+	OpenLevelImage(hFile); // if it fails, the file is read as usual
+#ifdef FEATURE_RENDER_IMPROVED
+	CheckLevelReload(hFile);
+#endif // FEATURE_RENDER_IMPROVED
+#endif // FEATURE_LOADING_IMPROVED
 
 	ReadFileSync(hFile, &levelVersion, sizeof(levelVersion), &bytesRead, NULL);
 	if( levelVersion != REQ_LEVEL_VERSION ) {
@@ -1172,19 +1536,29 @@ BOOL __cdecl LoadLevel(LPCTSTR fileName, int levelID) {
 	}
 #endif // (DIRECT3D_VERSION >= 0x900)
 
-	LevelFilePalettesOffset = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
+	LevelFilePalettesOffset = LevelFileSeek(hFile, 0, NULL, FILE_CURRENT);
 	if( !LoadPalettes(hFile) ) {
 		goto EXIT;
 	}
 
-	LevelFileTexPagesOffset = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
+	LevelFileTexPagesOffset = LevelFileSeek(hFile, 0, NULL, FILE_CURRENT);
 	if( !LoadTexturePages(hFile) ) {
 		goto EXIT;
 	}
 
 	ReadFileSync(hFile, &reserved, sizeof(reserved), &bytesRead, NULL);
+#if defined(FEATURE_LOADING_IMPROVED) && defined(FEATURE_RENDER_IMPROVED)
+	if( !LoadRooms(hFile) ) {
+		goto EXIT;
+	}
+	if( !IsLevelReload ) {
+		TASK_Run(PvsLevelInitTask, NULL);
+	}
+	if( !LoadObjects(hFile) ||
+#else // defined(FEATURE_LOADING_IMPROVED) && defined(FEATURE_RENDER_IMPROVED)
 	if( !LoadRooms(hFile) ||
 		!LoadObjects(hFile) ||
+#endif // defined(FEATURE_LOADING_IMPROVED) && defined(FEATURE_RENDER_IMPROVED)
 		!LoadSprites(hFile) ||
 		!LoadCameras(hFile) ||
 		!LoadSoundEffects(hFile) ||
@@ -1195,7 +1569,7 @@ BOOL __cdecl LoadLevel(LPCTSTR fileName, int levelID) {
 		goto EXIT;
 	}
 
-	LevelFileDepthQOffset = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
+	LevelFileDepthQOffset = LevelFileSeek(hFile, 0, NULL, FILE_CURRENT);
 	if( !LoadDepthQ(hFile) ||
 		!LoadCinematic(hFile) ||
 		!LoadDemo(hFile) ||
@@ -1205,21 +1579,54 @@ BOOL __cdecl LoadLevel(LPCTSTR fileName, int levelID) {
 	}
 
 	LoadDemoExternal(fullPath);
+#ifdef FEATURE_LOADING_IMPROVED
+	// the fix-ups below may depend on the worker tasks
+	TASK_WaitAll();
+#else // FEATURE_LOADING_IMPROVED
+#ifdef FEATURE_RENDER_IMPROVED
+	PVS_LevelInit();
+#endif // FEATURE_RENDER_IMPROVED
+#endif // FEATURE_LOADING_IMPROVED
 #ifdef FEATURE_VIDEOFX_IMPROVED
 	MarkSemitransObjects();
 	MarkSemitransTextureRanges();
 #endif // FEATURE_VIDEOFX_IMPROVED
+#ifdef FEATURE_ENGINE_IMPROVED
+	SIDX_LevelInit();
+	RGRID_LevelInit();
+	BZONE_LevelInit();
+#endif // FEATURE_ENGINE_IMPROVED
+#ifdef FEATURE_RENDER_IMPROVED
+	LPROBE_LevelInit();
+	VGRID_LevelInit();
+	LCLUST_LevelInit();
+#endif // FEATURE_RENDER_IMPROVED
 #ifdef FEATURE_BACKGROUND_IMPROVED
 	PatternTexPage = CreateBgndPatternTexture(hFile);
 #endif // FEATURE_BACKGROUND_IMPROVED
 	result = TRUE;
 
 EXIT :
+#ifdef FEATURE_LOADING_IMPROVED
+	TASK_WaitAll(); // the level may be unloaded after a failure
+#ifdef FEATURE_RENDER_IMPROVED
+	if( result ) {
+		TakeLevelSnapshot(hFile);
+	} else {
+		DropLevelSnapshot();
+	}
+#endif // FEATURE_RENDER_IMPROVED
+	CloseLevelImage();
+#endif // FEATURE_LOADING_IMPROVED
 	CloseHandle(hFile);
 	return result;
 }
 
 BOOL __cdecl S_LoadLevelFile(LPCTSTR fileName, int levelID, GF_LEVEL_TYPE levelType) {
+#ifdef FEATURE_EXTENDED_LIMITS
+	ARENA_Report(); // report the previous level frame buffers usage
+	GameAllocReport(); // and the previous level game memory usage
+#endif // FEATURE_EXTENDED_LIMITS
 	S_UnloadLevelFile();
 	LoadLevelType = levelType; // NOTE: this line is not presented in the original game
 #ifdef FEATURE_MOD_CONFIG
@@ -1250,6 +1657,22 @@ void __cdecl S_UnloadLevelFile() {
 	memset(TexturePageBuffer8, 0, sizeof(TexturePageBuffer8));
 	*LevelFileName = 0;
 	TextureInfoCount = 0;
+#ifdef FEATURE_RENDER_IMPROVED
+#ifndef FEATURE_LOADING_IMPROVED
+	// NOTE: with the improved loading these are kept for the level snapshot
+	CULL_Cleanup();
+	PVS_Cleanup();
+#endif // FEATURE_LOADING_IMPROVED
+	LPROBE_Cleanup();
+	VGRID_Cleanup();
+	LCLUST_Cleanup();
+#endif // FEATURE_RENDER_IMPROVED
+#ifdef FEATURE_ENGINE_IMPROVED
+	SIDX_Cleanup();
+	RGRID_Cleanup();
+	FCACHE_Cleanup();
+	BZONE_Cleanup();
+#endif // FEATURE_ENGINE_IMPROVED
 #ifdef FEATURE_MOD_CONFIG
 	UnloadModConfiguration();
 #endif // FEATURE_MOD_CONFIG
@@ -55,4 +55,8 @@ BOOL __cdecl S_ReloadLevelGraphics(BOOL reloadPalettes, BOOL reloadTexPages); //
 BOOL __cdecl Read_Strings(DWORD dwCount, char **stringTable, char **stringBuffer, LPDWORD lpBufferSize, HANDLE hFile); // 0x0044B6A0
 BOOL __cdecl S_LoadGameFlow(LPCTSTR fileName); // 0x0044B770
 
+#ifdef FEATURE_LOADING_IMPROVED
+void S_PrefetchLevelFile(LPCTSTR fileName);
+#endif // FEATURE_LOADING_IMPROVED
+
 #endif // FILE_H_INCLUDED
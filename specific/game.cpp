@@ -58,6 +58,10 @@ extern bool IsGold();
 extern void ResetGoldenLaraAlpha();
 #endif // FEATURE_VIDEOFX_IMPROVED
 
+#ifdef FEATURE_LOADING_IMPROVED
+extern int GF_GetNextLevel(DWORD levelID);
+#endif // FEATURE_LOADING_IMPROVED
+
 #ifdef FEATURE_HUD_IMPROVED
 extern bool GF_IsFinalLevel(DWORD levelID);
 extern void RemoveJoystickHintText(bool isSelect, bool isContinue, bool isDeselect);
@@ -199,6 +203,13 @@ int __cdecl LevelStats(int levelID) {
 
 	CreateStartInfo(levelID); // NOTE: this line is absent in the original code, but it's required for "Restart Level" feature
 	SaveGame.start[levelID].statistics = SaveGame.statistics;
+#ifdef FEATURE_LOADING_IMPROVED
+	// The next level is read in the background while the statistics are shown
+	int nextLevel = GF_GetNextLevel(levelID);
+	if( nextLevel >= 0 ) {
+		S_PrefetchLevelFile(GF_LevelFilesStringTable[nextLevel]);
+	}
+#endif // FEATURE_LOADING_IMPROVED
 
 	seconds = SaveGame.statistics.timer / 30 % 60;
 	minutes = SaveGame.statistics.timer / 30 / 60 % 60;
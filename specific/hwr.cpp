@@ -23,8 +23,13 @@
 #include "specific/hwr.h"
 #include "specific/init_display.h"
 #include "specific/texture.h"
+#include "modding/hwr_record.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_EXTENDED_LIMITS
+#include "3dsystem/3d_arena.h"
+#endif // FEATURE_EXTENDED_LIMITS
+
 #ifdef FEATURE_HUD_IMPROVED
 #include "modding/psx_bar.h"
 #endif // FEATURE_HUD_IMPROVED
@@ -57,6 +62,7 @@ static void SetBlendMode(D3DTLVERTEX *vtxPtr, DWORD vtxCount, DWORD mode) {
 	D3DDev->SetRenderState(D3DRENDERSTATE_SRCBLEND, Blend[mode].src);
 	D3DDev->SetRenderState(D3DRENDERSTATE_DESTBLEND, Blend[mode].dst);
 #endif // (DIRECT3D_VERSION >= 0x900)
+	HREC_RECORD(HREC_Blend, mode, 0, 0);
 }
 
 static void DrawAlphaBlended(D3DTLVERTEX *vtxPtr, DWORD vtxCount, DWORD mode) {
@@ -76,13 +82,52 @@ static void DrawAlphaBlended(D3DTLVERTEX *vtxPtr, DWORD vtxCount, DWORD mode) {
 	D3DDev->SetRenderState(D3DRENDERSTATE_SRCBLEND, D3DBLEND_SRCALPHA);
 	D3DDev->SetRenderState(D3DRENDERSTATE_DESTBLEND, D3DBLEND_INVSRCALPHA);
 #endif // (DIRECT3D_VERSION >= 0x900)
+	HREC_RECORD(HREC_Blend, 0, 0, 0);
 }
 #endif // FEATURE_VIDEOFX_IMPROVED
 
+#ifdef FEATURE_BENCHMARK
+// Gets the texture page index, so the recorded handles are the same in every run
+static DWORD GetTexSourceId(HWR_TEXHANDLE texSource) {
+	if( texSource == 0 ) return ~0;
+	for( DWORD i = 0; i < ARRAY_SIZE(HWR_PageHandles); ++i ) {
+		if( HWR_PageHandles[i] == texSource ) return i;
+	}
+	return ~1; // not a level texture page
+}
+#endif // FEATURE_BENCHMARK
+
+#if (DIRECT3D_VERSION >= 0x900)
+// Copies the vertices to the vertex buffer, and returns their buffer index
+static HRESULT LockVertexBuffer(LPVOID vertices, DWORD vertexCount, DWORD *vertexIndex) {
+	extern LPDIRECT3DVERTEXBUFFER9 D3DVtx;
+	static DWORD bufferIndex = 0;
+	DWORD flags = D3DLOCK_NOOVERWRITE;
+	if( vertexCount > VTXBUF_LEN ) {
+		return D3DERR_INVALIDCALL;
+	}
+	if( bufferIndex + vertexCount > VTXBUF_LEN ) {
+		bufferIndex = 0;
+		flags = D3DLOCK_DISCARD;
+	}
+	LPVOID ptr = NULL;
+	HRESULT res = D3DVtx->Lock(sizeof(D3DTLVERTEX) * bufferIndex, sizeof(D3DTLVERTEX) * vertexCount, &ptr, flags);
+	if FAILED(res) return res;
+	memcpy(ptr, vertices, sizeof(D3DTLVERTEX) * vertexCount);
+	D3DVtx->Unlock();
+	*vertexIndex = bufferIndex;
+	bufferIndex += vertexCount;
+	return D3D_OK;
+}
+#endif // (DIRECT3D_VERSION >= 0x900)
+
 // NOTE: this function is absent in the original code
 HRESULT HWR_DrawPrimitive(D3DPRIMITIVETYPE primitiveType, LPVOID vertices, DWORD vertexCount, bool isNoClip) {
+#ifdef FEATURE_BENCHMARK
+	HREC_RECORD(HREC_Draw, primitiveType, vertexCount, 0);
+	if( HwrNullDraw ) return D3D_OK;
+#endif // FEATURE_BENCHMARK
 #if (DIRECT3D_VERSION >= 0x900)
-	extern LPDIRECT3DVERTEXBUFFER9 D3DVtx;
 	int primitiveCount = 0;
 	switch( primitiveType ) {
 		case D3DPT_POINTLIST:		primitiveCount = vertexCount;   break;
@@ -96,25 +141,146 @@ HRESULT HWR_DrawPrimitive(D3DPRIMITIVETYPE primitiveType, LPVOID vertices, DWORD
 	if( primitiveCount <= 0 ) {
 		return D3DERR_INVALIDCALL;
 	}
-	static DWORD vertexIndex = 0;
+	DWORD vertexIndex = 0;
+	HRESULT res = LockVertexBuffer(vertices, vertexCount, &vertexIndex);
+	if FAILED(res) return res;
+	return D3DDev->DrawPrimitive(primitiveType, vertexIndex, primitiveCount);
+#else // (DIRECT3D_VERSION >= 0x900)
+	return D3DDev->DrawPrimitive(primitiveType, D3DVT_TLVERTEX, vertices, vertexCount, isNoClip ? D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP : 0);
+#endif // (DIRECT3D_VERSION >= 0x900)
+}
+
+#ifdef FEATURE_RENDER_IMPROVED
+// NOTE: this function is absent in the original code
+HRESULT HWR_DrawIndexedPrimitive(D3DPRIMITIVETYPE primitiveType, LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, bool isNoClip) {
+#ifdef FEATURE_BENCHMARK
+	HREC_RECORD(HREC_DrawIndexed, primitiveType, vertexCount, indexCount);
+	if( HwrNullDraw ) return D3D_OK;
+#endif // FEATURE_BENCHMARK
+#if (DIRECT3D_VERSION >= 0x900)
+	extern LPDIRECT3DINDEXBUFFER9 D3DIdx;
+	int primitiveCount = 0;
+	switch( primitiveType ) {
+		case D3DPT_LINELIST:		primitiveCount = indexCount/2; break;
+		case D3DPT_TRIANGLELIST:	primitiveCount = indexCount/3; break;
+		default: break;
+	}
+	if( primitiveCount <= 0 || indexCount > IDXBUF_LEN ) {
+		return D3DERR_INVALIDCALL;
+	}
+	static DWORD indexIndex = 0;
+	DWORD vertexIndex = 0;
 	DWORD flags = D3DLOCK_NOOVERWRITE;
-	if( vertexIndex + vertexCount > VTXBUF_LEN ) {
-		vertexIndex = 0;
+	if( indexIndex + indexCount > IDXBUF_LEN ) {
+		indexIndex = 0;
 		flags = D3DLOCK_DISCARD;
 	}
 	LPVOID ptr = NULL;
-	HRESULT res = D3DVtx->Lock(sizeof(D3DTLVERTEX) * vertexIndex, sizeof(D3DTLVERTEX) * vertexCount, &ptr, flags);
+	HRESULT res = D3DIdx->Lock(sizeof(WORD) * indexIndex, sizeof(WORD) * indexCount, &ptr, flags);
 	if FAILED(res) return res;
-	memcpy(ptr, vertices, sizeof(D3DTLVERTEX) * vertexCount);
-	D3DVtx->Unlock();
-	res = D3DDev->DrawPrimitive(primitiveType, vertexIndex, primitiveCount);
-	vertexIndex += vertexCount;
+	memcpy(ptr, indices, sizeof(WORD) * indexCount);
+	D3DIdx->Unlock();
+	res = LockVertexBuffer(vertices, vertexCount, &vertexIndex);
+	if FAILED(res) return res;
+	res = D3DDev->DrawIndexedPrimitive(primitiveType, vertexIndex, 0, vertexCount, indexIndex, primitiveCount);
+	indexIndex += indexCount;
 	return res;
 #else // (DIRECT3D_VERSION >= 0x900)
-	return D3DDev->DrawPrimitive(primitiveType, D3DVT_TLVERTEX, vertices, vertexCount, isNoClip ? D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP : 0);
+	return D3DDev->DrawIndexedPrimitive(primitiveType, D3DVT_TLVERTEX, vertices, vertexCount, indices, indexCount, isNoClip ? D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP : 0);
 #endif // (DIRECT3D_VERSION >= 0x900)
 }
 
+/*
+ * The consecutive triangle fans drawn with the same texture and color key
+ * state are merged into one indexed triangle list. The polygons are sorted
+ * by depth, so the batch is flushed before any other polygon is drawn, and
+ * the draw order is the same as before.
+ */
+#define BATCH_VTX_LEN (1024)
+#define BATCH_IDX_LEN (BATCH_VTX_LEN*3)
+
+static D3DTLVERTEX BatchVertices[BATCH_VTX_LEN];
+static WORD BatchIndices[BATCH_IDX_LEN];
+static DWORD BatchVertexCount = 0;
+static DWORD BatchIndexCount = 0;
+static HWR_TEXHANDLE BatchTexSource = 0;
+static bool BatchColorKey = false;
+
+static void FlushBatch() {
+	if( BatchVertexCount == 0 ) return;
+	HWR_TexSource(BatchTexSource);
+	HWR_EnableColorKey(BatchColorKey);
+	HWR_DrawIndexedPrimitive(D3DPT_TRIANGLELIST, BatchVertices, BatchVertexCount, BatchIndices, BatchIndexCount, true);
+	BatchVertexCount = 0;
+	BatchIndexCount = 0;
+}
+
+static void DrawBatchedFan(HWR_TEXHANDLE texSource, bool colorKey, D3DTLVERTEX *vtxPtr, DWORD vtxCount) {
+	if( BatchVertexCount > 0 && (BatchTexSource != texSource || BatchColorKey != colorKey ||
+		BatchVertexCount + vtxCount > BATCH_VTX_LEN) )
+	{
+		FlushBatch();
+	}
+	// the degenerate and too large fans are drawn as before
+	if( vtxCount < 3 || vtxCount > BATCH_VTX_LEN ) {
+		FlushBatch();
+		HWR_TexSource(texSource);
+		HWR_EnableColorKey(colorKey);
+		HWR_DrawPrimitive(D3DPT_TRIANGLEFAN, vtxPtr, vtxCount, true);
+		return;
+	}
+	BatchTexSource = texSource;
+	BatchColorKey = colorKey;
+	memcpy(&BatchVertices[BatchVertexCount], vtxPtr, sizeof(D3DTLVERTEX) * vtxCount);
+	for( DWORD i = 2; i < vtxCount; ++i ) {
+		BatchIndices[BatchIndexCount++] = BatchVertexCount;
+		BatchIndices[BatchIndexCount++] = BatchVertexCount + i - 1;
+		BatchIndices[BatchIndexCount++] = BatchVertexCount + i;
+	}
+	BatchVertexCount += vtxCount;
+}
+
+// Gets the render state if the polygon is drawn as a plain triangle fan
+static bool GetBatchState(UINT16 polyType, UINT16 texPage, HWR_TEXHANDLE *texSource, bool *colorKey) {
+	switch( polyType ) {
+		case POLY_HWR_GTmap :
+		case POLY_HWR_WGTmap :
+#ifdef FEATURE_VIDEOFX_IMPROVED
+		case POLY_HWR_WGTmapHalf :
+		case POLY_HWR_WGTmapAdd :
+		case POLY_HWR_WGTmapSub :
+		case POLY_HWR_WGTmapQrt :
+			if( TextureFormat.bpp >= 16 && AlphaBlendMode != 0 && polyType != POLY_HWR_GTmap && polyType != POLY_HWR_WGTmap ) {
+				return false;
+			}
+			*texSource = ( texPage == (UINT16)~0 ) ? GetEnvmapTextureHandle() : HWR_PageHandles[texPage];
+#else // !FEATURE_VIDEOFX_IMPROVED
+			*texSource = HWR_PageHandles[texPage];
+#endif // !FEATURE_VIDEOFX_IMPROVED
+			*colorKey = ( polyType != POLY_HWR_GTmap );
+			return true;
+
+		case POLY_HWR_gouraud :
+#ifdef FEATURE_VIDEOFX_IMPROVED
+		case POLY_HWR_half :
+		case POLY_HWR_add :
+		case POLY_HWR_sub :
+		case POLY_HWR_qrt :
+			if( TextureFormat.bpp >= 16 && AlphaBlendMode != 0 && polyType != POLY_HWR_gouraud ) {
+				return false;
+			}
+#endif // FEATURE_VIDEOFX_IMPROVED
+			*texSource = 0;
+			*colorKey = ( polyType != POLY_HWR_gouraud );
+			return true;
+
+		default :
+			break;
+	}
+	return false;
+}
+#endif // FEATURE_RENDER_IMPROVED
+
 void __cdecl HWR_InitState() {
 #if (DIRECT3D_VERSION >= 0x900)
 	D3DDev->SetRenderState(D3DRS_CLIPPING, FALSE);
@@ -170,6 +336,7 @@ void __cdecl HWR_InitState() {
 
 void __cdecl HWR_ResetTexSource() {
 	CurrentTexSource = 0;
+	HREC_RECORD(HREC_Texture, 0, 0, ~0);
 #if (DIRECT3D_VERSION >= 0x900)
 	D3DDev->SetTexture(0, NULL);
 #else // (DIRECT3D_VERSION >= 0x900)
@@ -180,6 +347,7 @@ void __cdecl HWR_ResetTexSource() {
 
 void __cdecl HWR_ResetColorKey() {
 	ColorKeyState = FALSE;
+	HREC_RECORD(HREC_ColorKey, FALSE, 0, 0);
 #if (DIRECT3D_VERSION >= 0x900)
 	D3DDev->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
 #else // (DIRECT3D_VERSION >= 0x900)
@@ -190,6 +358,8 @@ void __cdecl HWR_ResetColorKey() {
 void __cdecl HWR_ResetZBuffer() {
 	ZEnableState = FALSE;
 	ZWriteEnableState = FALSE;
+	HREC_RECORD(HREC_ZEnable, FALSE, 0, 0);
+	HREC_RECORD(HREC_ZWrite, FALSE, 0, 0);
 #if (DIRECT3D_VERSION >= 0x900)
 	D3DDev->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
 	D3DDev->SetRenderState(D3DRS_ZWRITEENABLE, D3DZB_FALSE);
@@ -213,6 +383,7 @@ void __cdecl HWR_TexSource(HWR_TEXHANDLE texSource) {
 		D3DDev->SetRenderState(D3DRENDERSTATE_TEXTUREHANDLE, texSource);
 #endif // (DIRECT3D_VERSION >= 0x900)
 		CurrentTexSource = texSource;
+		HREC_RECORD(HREC_Texture, 0, 0, GetTexSourceId(texSource));
 	}
 }
 
@@ -224,6 +395,7 @@ void __cdecl HWR_EnableColorKey(bool state) {
 		D3DDev->SetRenderState(TexturesAlphaChannel ? D3DRENDERSTATE_ALPHABLENDENABLE : D3DRENDERSTATE_COLORKEYENABLE, state ? TRUE : FALSE);
 #endif // (DIRECT3D_VERSION >= 0x900)
 		ColorKeyState = state;
+		HREC_RECORD(HREC_ColorKey, state, 0, 0);
 	}
 }
 
@@ -238,6 +410,7 @@ void __cdecl HWR_EnableZBuffer(bool ZWriteEnable, bool ZEnable) {
 		D3DDev->SetRenderState(D3DRENDERSTATE_ZWRITEENABLE, ZWriteEnable ? TRUE : FALSE);
 #endif // (DIRECT3D_VERSION >= 0x900)
 		ZWriteEnableState = ZWriteEnable;
+		HREC_RECORD(HREC_ZWrite, ZWriteEnable, 0, 0);
 	}
 
 	if( ZEnableState != ZEnable ) {
@@ -250,6 +423,7 @@ void __cdecl HWR_EnableZBuffer(bool ZWriteEnable, bool ZEnable) {
 			D3DDev->SetRenderState(D3DRENDERSTATE_ZENABLE, ZEnable ? TRUE : FALSE);
 #endif // (DIRECT3D_VERSION >= 0x900)
 		ZEnableState = ZEnable;
+		HREC_RECORD(HREC_ZEnable, ZEnable, 0, 0);
 	}
 }
 
@@ -259,6 +433,7 @@ void __cdecl HWR_BeginScene() {
 	WaitPrimaryBufferFlip();
 #endif // (DIRECT3D_VERSION < 0x900)
 	D3DDev->BeginScene();
+	HREC_RECORD(HREC_BeginScene, 0, 0, 0);
 }
 
 void __cdecl HWR_DrawPolyList() {
@@ -274,6 +449,9 @@ void __cdecl HWR_DrawPolyList() {
 		polyType = *(bufPtr++);
 #ifdef FEATURE_HUD_IMPROVED
 		if( polyType == POLY_HWR_healthbar || polyType == POLY_HWR_airbar ) {
+#ifdef FEATURE_RENDER_IMPROVED
+			FlushBatch();
+#endif // FEATURE_RENDER_IMPROVED
 			UINT16 x0 = *(bufPtr++);
 			UINT16 y0 = *(bufPtr++);
 			UINT16 x1 = *(bufPtr++);
@@ -309,6 +487,16 @@ void __cdecl HWR_DrawPolyList() {
 		vtxCount = *(bufPtr++);
 		vtxPtr = *(D3DTLVERTEX **)bufPtr;
 
+#ifdef FEATURE_RENDER_IMPROVED
+		HWR_TEXHANDLE texSource;
+		bool colorKey;
+		if( GetBatchState(polyType, texPage, &texSource, &colorKey) ) {
+			DrawBatchedFan(texSource, colorKey, vtxPtr, vtxCount);
+			continue;
+		}
+		FlushBatch();
+#endif // FEATURE_RENDER_IMPROVED
+
 		switch( polyType ) {
 			case POLY_HWR_GTmap: // triangle fan (texture)
 			case POLY_HWR_WGTmap: // triangle fan (texture + colorkey)
@@ -361,11 +549,16 @@ void __cdecl HWR_DrawPolyList() {
 				HWR_TexSource(0);
 				D3DDev->GetRenderState(AlphaBlendEnabler, &alphaState);
 				D3DDev->SetRenderState(AlphaBlendEnabler, TRUE);
+				HREC_RECORD(HREC_AlphaBlend, TRUE, 0, 0);
 				HWR_DrawPrimitive(D3DPT_TRIANGLEFAN, vtxPtr, vtxCount, true);
 				D3DDev->SetRenderState(AlphaBlendEnabler, alphaState);
+				HREC_RECORD(HREC_AlphaBlend, alphaState, 0, 0);
 				break;
 		}
 	}
+#ifdef FEATURE_RENDER_IMPROVED
+	FlushBatch();
+#endif // FEATURE_RENDER_IMPROVED
 }
 
 void __cdecl HWR_LoadTexturePages(int pagesCount, LPVOID pagesBuffer, RGB888 *palette) {
@@ -431,11 +624,19 @@ void __cdecl HWR_GetPageHandles() {
 
 bool __cdecl HWR_VertexBufferFull() {
 	DWORD index = ((DWORD)HWR_VertexPtr - (DWORD)HWR_VertexBuffer) / sizeof(D3DTLVERTEX);
+#ifdef FEATURE_EXTENDED_LIMITS
+	// The buffers grow here, so they are full only if they cannot grow anymore
+	return !VertexListReserve(index + 0x200) || !PolyListReserve(1, POLY_INFO_MAX);
+#else // FEATURE_EXTENDED_LIMITS
 	return (index >= ARRAY_SIZE(HWR_VertexBuffer) - 0x200);
+#endif // FEATURE_EXTENDED_LIMITS
 }
 
 bool __cdecl HWR_Init() {
+#ifndef FEATURE_EXTENDED_LIMITS
+	// NOTE: the vertex arena memory is zero filled by the system
 	memset(HWR_VertexBuffer, 0, sizeof(HWR_VertexBuffer));
+#endif // FEATURE_EXTENDED_LIMITS
 	memset(HWR_TexturePageIndexes, 0xFF, sizeof(HWR_TexturePageIndexes)); // fill indexes by -1
 	return true;
 }
@@ -29,6 +29,9 @@
  */
 // NOTE: this function is absent in the original code
 HRESULT HWR_DrawPrimitive(D3DPRIMITIVETYPE primitiveType, LPVOID vertices, DWORD vertexCount, bool isNoClip);
+#ifdef FEATURE_RENDER_IMPROVED
+HRESULT HWR_DrawIndexedPrimitive(D3DPRIMITIVETYPE primitiveType, LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, bool isNoClip);
+#endif // FEATURE_RENDER_IMPROVED
 
 void __cdecl HWR_InitState(); // 0x0044D0B0
 void __cdecl HWR_ResetTexSource(); // 0x0044D1E0
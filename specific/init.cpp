@@ -78,6 +78,122 @@ static LPCTSTR BufferNames[] = {
 	"Sprite Infos",
 };
 
+#ifdef FEATURE_EXTENDED_LIMITS
+#define GAMEALLOC_MAX_CHUNKS	(16)
+
+typedef struct GameAllocChunk_t {
+	BYTE *base;
+	DWORD size;
+	DWORD used; // saved when the next chunk is taken
+} GAMEALLOC_CHUNK;
+
+typedef struct GameAllocRecord_t {
+	DWORD bufIndex;
+	DWORD size;
+} GAMEALLOC_RECORD;
+
+// If enabled, game_malloc takes the next memory chunk instead of the exit on overflow
+bool GameMemoryGrowth = false;
+
+// The first chunk is the original game memory, the others are allocated on demand
+// and kept until the game shutdown. An allocation never crosses a chunk boundary.
+static GAMEALLOC_CHUNK GameAllocChunks[GAMEALLOC_MAX_CHUNKS];
+static int GameAllocChunksCount = 0;
+static int GameAllocChunkIndex = 0;
+
+// game_free gets the size only, so the LIFO stack of allocations is kept to know
+// the category of the freed memory
+static GAMEALLOC_RECORD *GameAllocRecords = NULL;
+static DWORD GameAllocRecordsCount = 0;
+static DWORD GameAllocRecordsCapacity = 0;
+
+static DWORD GameAllocCategoryUsed[ARRAY_SIZE(BufferNames)];
+static DWORD GameAllocCategoryHighWater[ARRAY_SIZE(BufferNames)];
+static DWORD GameAllocHighWater = 0;
+
+static void GameAllocAccount(DWORD bufIndex, DWORD size) {
+	if( bufIndex >= ARRAY_SIZE(BufferNames) ) bufIndex = GBUF_TempAlloc;
+	GameAllocCategoryUsed[bufIndex] += size;
+	CLAMPL(GameAllocCategoryHighWater[bufIndex], GameAllocCategoryUsed[bufIndex]);
+	CLAMPL(GameAllocHighWater, GameAllocMemUsed);
+
+	if( GameAllocRecordsCount > 0 && GameAllocRecords[GameAllocRecordsCount - 1].bufIndex == bufIndex ) {
+		// the same category allocations are merged, so the stack is short
+		GameAllocRecords[GameAllocRecordsCount - 1].size += size;
+		return;
+	}
+	if( GameAllocRecordsCount == GameAllocRecordsCapacity ) {
+		DWORD capacity = GameAllocRecordsCapacity ? GameAllocRecordsCapacity * 2 : 256;
+		GAMEALLOC_RECORD *records = (GAMEALLOC_RECORD *)realloc(GameAllocRecords, sizeof(GAMEALLOC_RECORD) * capacity);
+		if( records == NULL ) return; // the accounting is not critical
+		GameAllocRecords = records;
+		GameAllocRecordsCapacity = capacity;
+	}
+	GameAllocRecords[GameAllocRecordsCount].bufIndex = bufIndex;
+	GameAllocRecords[GameAllocRecordsCount].size = size;
+	++GameAllocRecordsCount;
+}
+
+static void GameAllocUnaccount(DWORD size) {
+	while( size > 0 && GameAllocRecordsCount > 0 ) {
+		GAMEALLOC_RECORD *record = &GameAllocRecords[GameAllocRecordsCount - 1];
+		DWORD n = MIN(size, record->size);
+		GameAllocCategoryUsed[record->bufIndex] -= n;
+		record->size -= n;
+		size -= n;
+		if( record->size == 0 ) {
+			--GameAllocRecordsCount;
+		}
+	}
+}
+
+static bool GameAllocNextChunk(DWORD allocSize) {
+	GAMEALLOC_CHUNK *chunk;
+
+	if( GameAllocChunkIndex + 1 >= GAMEALLOC_MAX_CHUNKS ) return false;
+	chunk = &GameAllocChunks[GameAllocChunkIndex + 1];
+	if( chunk->base != NULL && chunk->size < allocSize ) {
+		// the kept chunk is too small for this allocation, so it's replaced
+		GlobalFree(chunk->base);
+		chunk->base = NULL;
+		--GameAllocChunksCount;
+	}
+	if( chunk->base == NULL ) {
+		chunk->size = MAX(GameMemorySize, allocSize);
+		chunk->base = (BYTE *)GlobalAlloc(GMEM_FIXED, chunk->size);
+		if( chunk->base == NULL ) return false;
+		++GameAllocChunksCount;
+		printf("game_malloc(): added memory chunk %d of %lu bytes\n", GameAllocChunkIndex + 1, chunk->size);
+		fflush(stdout);
+	}
+	GameAllocChunks[GameAllocChunkIndex].used = GameAllocMemPointer - GameAllocChunks[GameAllocChunkIndex].base;
+	++GameAllocChunkIndex;
+	chunk->used = 0;
+	GameAllocMemPointer = chunk->base;
+	GameAllocMemFree = chunk->size;
+	return true;
+}
+
+static void GameAllocPrevChunk() {
+	GAMEALLOC_CHUNK *chunk = &GameAllocChunks[--GameAllocChunkIndex];
+	GameAllocMemPointer = chunk->base + chunk->used;
+	GameAllocMemFree = chunk->size - chunk->used;
+}
+
+// Writes the game memory usage of the finished level into the log
+void GameAllocReport() {
+	if( GameAllocHighWater == 0 ) return;
+	printf("game_malloc(): high-water=%lu size=%lu chunks=%d\n",
+		GameAllocHighWater, GameMemorySize, GameAllocChunksCount + 1);
+	for( DWORD i = 0; i < ARRAY_SIZE(BufferNames); ++i ) {
+		if( GameAllocCategoryHighWater[i] == 0 ) continue;
+		printf("game_malloc(): %s high-water=%lu used=%lu\n",
+			BufferNames[i], GameAllocCategoryHighWater[i], GameAllocCategoryUsed[i]);
+	}
+	fflush(stdout);
+}
+#endif // FEATURE_EXTENDED_LIMITS
+
 BOOL __cdecl S_InitialiseSystem() {
 	S_SeedRandom();
 	DumpX = 0;
@@ -98,35 +214,94 @@ void __cdecl ShutdownGame() {
 		GlobalFree(GameMemoryPointer);
 		GameMemoryPointer = NULL;
 	}
+#ifdef FEATURE_EXTENDED_LIMITS
+	for( int i = 1; i < GAMEALLOC_MAX_CHUNKS; ++i ) {
+		if( GameAllocChunks[i].base != NULL ) {
+			GlobalFree(GameAllocChunks[i].base);
+		}
+	}
+	memset(GameAllocChunks, 0, sizeof(GameAllocChunks));
+	GameAllocChunksCount = 0;
+	GameAllocChunkIndex = 0;
+	if( GameAllocRecords != NULL ) {
+		free(GameAllocRecords);
+		GameAllocRecords = NULL;
+	}
+	GameAllocRecordsCount = 0;
+	GameAllocRecordsCapacity = 0;
+#endif // FEATURE_EXTENDED_LIMITS
 }
 
 void __cdecl init_game_malloc() {
 	GameAllocMemPointer = GameMemoryPointer;
 	GameAllocMemFree = GameMemorySize;
 	GameAllocMemUsed = 0;
+#ifdef FEATURE_EXTENDED_LIMITS
+	GameAllocChunks[0].base = GameMemoryPointer;
+	GameAllocChunks[0].size = GameMemorySize;
+	GameAllocChunkIndex = 0;
+	GameAllocRecordsCount = 0;
+	GameAllocHighWater = 0;
+	memset(GameAllocCategoryUsed, 0, sizeof(GameAllocCategoryUsed));
+	memset(GameAllocCategoryHighWater, 0, sizeof(GameAllocCategoryHighWater));
+#endif // FEATURE_EXTENDED_LIMITS
 }
 
 void *__cdecl game_malloc(DWORD allocSize, DWORD bufIndex) {
 	DWORD alignedSize = (allocSize + 3) & ~3;
 	if( alignedSize > GameAllocMemFree ) {
+#ifdef FEATURE_EXTENDED_LIMITS
+		if( !GameMemoryGrowth || !GameAllocNextChunk(alignedSize) ) {
+			GameAllocReport(); // shows what has taken the memory
+			wsprintf(StringToShow, "game_malloc(): OUT OF MEMORY %s %d", BufferNames[bufIndex], alignedSize);
+			S_ExitSystem(StringToShow);
+			return NULL; // the app is terminated here
+		}
+#else // FEATURE_EXTENDED_LIMITS
 		wsprintf(StringToShow, "game_malloc(): OUT OF MEMORY %s %d", BufferNames[bufIndex], alignedSize);
 		S_ExitSystem(StringToShow);
 		return NULL; // the app is terminated here
+#endif // FEATURE_EXTENDED_LIMITS
 	}
 
 	void *result = GameAllocMemPointer;
 	GameAllocMemFree -= alignedSize;
 	GameAllocMemUsed += alignedSize;
 	GameAllocMemPointer += alignedSize;
+#ifdef FEATURE_EXTENDED_LIMITS
+	GameAllocAccount(bufIndex, alignedSize);
+#endif // FEATURE_EXTENDED_LIMITS
 	return result;
 }
 
 void __cdecl game_free(DWORD freeSize) {
 	DWORD alignedSize = (freeSize + 3) & ~3;
 
+#ifdef FEATURE_EXTENDED_LIMITS
+	GameAllocUnaccount(alignedSize);
+	while( alignedSize > 0 ) {
+		DWORD chunkUsed = GameAllocMemPointer - GameAllocChunks[GameAllocChunkIndex].base;
+		if( chunkUsed == 0 ) {
+			// the freed memory is in the previous chunk
+			if( GameAllocChunkIndex == 0 ) break;
+			GameAllocPrevChunk();
+			continue;
+		}
+		DWORD n = MIN(alignedSize, chunkUsed);
+		GameAllocMemPointer -= n;
+		GameAllocMemFree += n;
+		GameAllocMemUsed -= n;
+		alignedSize -= n;
+	}
+	// the emptied chunk is left, so the previous chunk tail may be used again
+	while( GameAllocChunkIndex > 0 && GameAllocMemPointer == GameAllocChunks[GameAllocChunkIndex].base ) {
+		GameAllocPrevChunk();
+	}
+#else // FEATURE_EXTENDED_LIMITS
 	GameAllocMemPointer -= alignedSize;
 	GameAllocMemFree += alignedSize;
 	GameAllocMemUsed -= alignedSize;
+#endif // FEATURE_EXTENDED_LIMITS
 }
 
 void __cdecl CalculateWibbleTable() {
@@ -25,6 +25,9 @@
 
 #if (DIRECT3D_VERSION >= 0x900)
 LPDIRECT3DVERTEXBUFFER9 D3DVtx = NULL;
+#ifdef FEATURE_RENDER_IMPROVED
+LPDIRECT3DINDEXBUFFER9 D3DIdx = NULL;
+#endif // FEATURE_RENDER_IMPROVED
 #endif // (DIRECT3D_VERSION >= 0x900)
 
 #if (DIRECT3D_VERSION < 0x900)
@@ -142,6 +145,12 @@ void __cdecl D3DDeviceCreate(LPDDS lpBackBuffer) {
 			D3DVtx->Release();
 			D3DVtx = NULL;
 		}
+#ifdef FEATURE_RENDER_IMPROVED
+		if( D3DIdx != NULL ) {
+			D3DIdx->Release();
+			D3DIdx = NULL;
+		}
+#endif // FEATURE_RENDER_IMPROVED
 		HRESULT res = D3D_OK;
 		do {
 			res = D3DDev->TestCooperativeLevel();
@@ -161,6 +170,12 @@ void __cdecl D3DDeviceCreate(LPDDS lpBackBuffer) {
 
 	D3DDev->SetStreamSource(0, D3DVtx, 0, sizeof(D3DTLVERTEX));
 	D3DDev->SetFVF(D3DFVF_TLVERTEX);
+#ifdef FEATURE_RENDER_IMPROVED
+	if( !D3DIdx && FAILED(D3DDev->CreateIndexBuffer(sizeof(WORD) * IDXBUF_LEN, D3DUSAGE_WRITEONLY|D3DUSAGE_DYNAMIC, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &D3DIdx, NULL)) )
+		throw ERR_CreateDevice;
+
+	D3DDev->SetIndices(D3DIdx);
+#endif // FEATURE_RENDER_IMPROVED
 #else // (DIRECT3D_VERSION >= 0x900)
 	if FAILED(D3D->CreateDevice(IID_IDirect3DHALDevice, (LPDIRECTDRAWSURFACE)lpBackBuffer, &D3DDev))
 		throw ERR_CreateDevice;
@@ -199,6 +214,12 @@ void __cdecl Direct3DRelease() {
 		D3DVtx->Release();
 		D3DVtx = NULL;
 	}
+#ifdef FEATURE_RENDER_IMPROVED
+	if( D3DIdx != NULL ) {
+		D3DIdx->Release();
+		D3DIdx = NULL;
+	}
+#endif // FEATURE_RENDER_IMPROVED
 #else // (DIRECT3D_VERSION >= 0x900)
 	if( D3DMaterial != NULL ) {
 		D3DMaterial->Release();
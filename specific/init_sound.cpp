@@ -23,6 +23,10 @@
 #include "specific/init_sound.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_LOADING_IMPROVED
+#include "modding/sample_bank.h"
+#endif // FEATURE_LOADING_IMPROVED
+
 extern void __thiscall FlaggedStringCreate(STRING_FLAGGED *item, DWORD dwSize);
 extern void __thiscall FlaggedStringDelete(STRING_FLAGGED *item);
 extern bool FlaggedStringCopy(STRING_FLAGGED *dst, STRING_FLAGGED *src);
@@ -297,6 +301,9 @@ bool __cdecl DSoundBufferTest() {
 
 void __cdecl WinSndFinish() {
 	WinSndFreeAllSamples();
+#ifdef FEATURE_LOADING_IMPROVED
+	SFX_Cleanup(); // the cached sound buffers belong to this DirectSound object
+#endif // FEATURE_LOADING_IMPROVED
 	if( DSound != NULL ) {
 		DSound->Release();
 		DSound = NULL;
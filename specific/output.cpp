@@ -37,6 +37,11 @@
 #include "specific/winvid.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_BENCHMARK
+#include "modding/benchmark.h"
+#include "modding/hwr_record.h"
+#endif // FEATURE_BENCHMARK
+
 #ifdef FEATURE_HUD_IMPROVED
 #include "modding/psx_bar.h"
 
@@ -50,6 +55,12 @@ double InvGUI_Scale = 1.0;
 extern int CalculateFogShade(int depth);
 #endif // FEATURE_VIEW_IMPROVED
 
+#ifdef FEATURE_RENDER_IMPROVED
+#include "modding/light_cluster.h"
+#include "modding/light_probe.h"
+#include "modding/vertex_grid.h"
+#endif // FEATURE_RENDER_IMPROVED
+
 #ifdef FEATURE_VIDEOFX_IMPROVED
 DWORD ShadowMode = 1;
 #endif // FEATURE_VIDEOFX_IMPROVED
@@ -252,6 +263,14 @@ void __cdecl S_InitialisePolyList(BOOL clearBackBuffer) {
 }
 
 DWORD __cdecl S_DumpScreen() {
+#ifdef FEATURE_BENCHMARK
+	if( BENCH_IsDemoPlaying() ) {
+		// the demo is not synced to the real time, so every run is the same
+		UpdateTicks();
+		ScreenPartialDump();
+		return TICKS_PER_FRAME;
+	}
+#endif // FEATURE_BENCHMARK
 	DWORD ticks = SyncTicks(TICKS_PER_FRAME); // NOTE: there was another code in the original game
 	ScreenPartialDump();
 	return ticks;
@@ -295,7 +314,14 @@ void __cdecl S_OutputPolyList() {
 		// do software rendering
 		extern void PrepareSWR(int pitch, int height);
 		PrepareSWR(RenderBuffer.width, RenderBuffer.height);
+#ifdef FEATURE_BENCHMARK
+		BENCH_START(BENCH_Print);
+		phd_PrintPolyList(RenderBuffer.bitmap);
+		BENCH_STOP(BENCH_Print);
+		BENCH_FrameSW(RenderBuffer.bitmap, RenderBuffer.width, RenderBuffer.height, RenderBuffer.width);
+#else // FEATURE_BENCHMARK
 		phd_PrintPolyList(RenderBuffer.bitmap);
+#endif // FEATURE_BENCHMARK
 		// finish surface lock
 		if( rc == D3DERR_WASSTILLDRAWING && FAILED(CaptureBufferSurface->LockRect(&desc, NULL, 0)) ) {
 			return;
@@ -320,11 +346,18 @@ void __cdecl S_OutputPolyList() {
 		CaptureBufferSurface->UnlockRect();
 #else // (DIRECT3D_VERSION >= 0x900)
 		if SUCCEEDED(WinVidBufferLock(RenderBufferSurface, &desc, DDLOCK_WRITEONLY|DDLOCK_WAIT)) {
-#ifdef FEATURE_NOLEGACY_OPTIONS
+#if defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
 			extern void PrepareSWR(int pitch, int height);
 			PrepareSWR(desc.lPitch, desc.dwHeight);
-#endif // FEATURE_NOLEGACY_OPTIONS
+#endif // defined(FEATURE_NOLEGACY_OPTIONS) || defined(FEATURE_EXTENDED_LIMITS)
+#ifdef FEATURE_BENCHMARK
+			BENCH_START(BENCH_Print);
 			phd_PrintPolyList((BYTE *)desc.lpSurface);
+			BENCH_STOP(BENCH_Print);
+			BENCH_FrameSW((BYTE *)desc.lpSurface, desc.dwWidth, desc.dwHeight, desc.lPitch);
+#else // FEATURE_BENCHMARK
+			phd_PrintPolyList((BYTE *)desc.lpSurface);
+#endif // FEATURE_BENCHMARK
 			WinVidBufferUnlock(RenderBufferSurface, &desc);
 		}
 #endif // (DIRECT3D_VERSION >= 0x900)
@@ -333,9 +366,19 @@ void __cdecl S_OutputPolyList() {
 		if( !SavedAppSettings.ZBuffer || !SavedAppSettings.DontSortPrimitives ) {
 			phd_SortPolyList();
 		}
+#ifdef FEATURE_BENCHMARK
+		BENCH_START(BENCH_Print);
+		HWR_DrawPolyList();
+		BENCH_STOP(BENCH_Print);
+#else // FEATURE_BENCHMARK
 		HWR_DrawPolyList();
+#endif // FEATURE_BENCHMARK
 		D3DDev->EndScene();
 	}
+#ifdef FEATURE_BENCHMARK
+	BENCH_FrameEnd();
+	HREC_FrameEnd();
+#endif // FEATURE_BENCHMARK
 }
 
 int __cdecl S_GetObjectBounds(__int16 *bPtr) {
@@ -511,10 +554,21 @@ void __cdecl S_CalculateLight(int x, int y, int z, __int16 roomNumber) {
 	room = &RoomInfo[roomNumber];
 	brightest = 0;
 
+	int lightsCount = room->numLights;
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the lights that may be the brightest here are checked
+	UINT16 *lights = LPROBE_GetLights(roomNumber, x, y, z, &lightsCount);
+#endif // FEATURE_RENDER_IMPROVED
+
 	// Static light calculation
 	if( room->lightMode != 0 ) {
 		lightShade = RoomLightShades[room->lightMode];
-		for( int i = 0; i < room->numLights; ++i ) {
+		for( int j = 0; j < lightsCount; ++j ) {
+#ifdef FEATURE_RENDER_IMPROVED
+			int i = ( lights != NULL ) ? lights[j] : j;
+#else // FEATURE_RENDER_IMPROVED
+			int i = j;
+#endif // FEATURE_RENDER_IMPROVED
 			xDist = x - room->light[i].x;
 			yDist = y - room->light[i].y;
 			zDist = z - room->light[i].z;
@@ -538,7 +592,12 @@ void __cdecl S_CalculateLight(int x, int y, int z, __int16 roomNumber) {
 			}
 		}
 	} else {
-		for( int i = 0; i < room->numLights; ++i ) {
+		for( int j = 0; j < lightsCount; ++j ) {
+#ifdef FEATURE_RENDER_IMPROVED
+			int i = ( lights != NULL ) ? lights[j] : j;
+#else // FEATURE_RENDER_IMPROVED
+			int i = j;
+#endif // FEATURE_RENDER_IMPROVED
 			xDist = x - room->light[i].x;
 			yDist = y - room->light[i].y;
 			zDist = z - room->light[i].z;
@@ -560,7 +619,15 @@ void __cdecl S_CalculateLight(int x, int y, int z, __int16 roomNumber) {
 	adder = brightest;
 
 	// Dynamic light calculation
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the lights overlapping the room are checked
+	int dynamicCount = DynamicLightCount;
+	UINT16 *dynamicLights = LCLUST_GetLights(roomNumber, x, z, &dynamicCount);
+	for( int j = 0; j < dynamicCount; ++j ) {
+		int i = ( dynamicLights != NULL ) ? dynamicLights[j] : j;
+#else // FEATURE_RENDER_IMPROVED
 	for( DWORD i = 0; i < DynamicLightCount; ++i ) {
+#endif // FEATURE_RENDER_IMPROVED
 		xDist = x - DynamicLights[i].x;
 		yDist = y - DynamicLights[i].y;
 		zDist = z - DynamicLights[i].z;
@@ -635,7 +702,15 @@ void __cdecl S_CalculateStaticMeshLight(int x, int y, int z, int shade1, int sha
 		adder += (shade2 - shade1) * RoomLightShades[room->lightMode] / (WIBBLE_SIZE-1);
 	}
 
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the lights overlapping the room are checked
+	int dynamicCount = DynamicLightCount;
+	UINT16 *dynamicLights = LCLUST_GetLights(room - RoomInfo, x, z, &dynamicCount);
+	for( int j = 0; j < dynamicCount; ++j ) {
+		int i = ( dynamicLights != NULL ) ? dynamicLights[j] : j;
+#else // FEATURE_RENDER_IMPROVED
 	for( DWORD i = 0; i < DynamicLightCount; ++i ) {
+#endif // FEATURE_RENDER_IMPROVED
 		xDist = x - DynamicLights[i].x;
 		yDist = y - DynamicLights[i].y;
 		zDist = z - DynamicLights[i].z;
@@ -680,20 +755,39 @@ void __cdecl S_LightRoom(ROOM_INFO *room) {
 		}
 	}
 	else if( (room->flags & 0x10) != 0 ) {
-		roomVtxCount = *room->data;
-		roomVtx = (ROOM_VERTEX_INFO *)(room->data + 1);
-		for( int i = 0; i < roomVtxCount; ++i ) {
-			roomVtx[i].lightAdder = roomVtx[i].lightBase;
+#ifdef FEATURE_RENDER_IMPROVED
+		// only the vertices changed by the dynamic lights are restored
+		if( !VGRID_RestoreRoom(room) )
+#endif // FEATURE_RENDER_IMPROVED
+		{
+			roomVtxCount = *room->data;
+			roomVtx = (ROOM_VERTEX_INFO *)(room->data + 1);
+			for( int i = 0; i < roomVtxCount; ++i ) {
+				roomVtx[i].lightAdder = roomVtx[i].lightBase;
+			}
 		}
 		room->flags &= ~0x10;
 	}
 
+#ifdef FEATURE_RENDER_IMPROVED
+	// the dynamic lights visit only the room sectors within their radius
+	if( VGRID_LightRoom(room) ) return;
+#endif // FEATURE_RENDER_IMPROVED
+
 	int xMin = 0x400;
 	int zMin = 0x400;
 	int xMax = 0x400 * (room->ySize - 1);
 	int zMax = 0x400 * (room->xSize - 1);
 
+#ifdef FEATURE_RENDER_IMPROVED
+	// only the lights overlapping the room are checked
+	int dynamicCount = DynamicLightCount;
+	UINT16 *dynamicLights = LCLUST_GetRoomLights(room - RoomInfo, &dynamicCount);
+	for( int n = 0; n < dynamicCount; ++n ) {
+		int i = ( dynamicLights != NULL ) ? dynamicLights[n] : n;
+#else // FEATURE_RENDER_IMPROVED
 	for( DWORD i = 0; i < DynamicLightCount; ++i ) {
+#endif // FEATURE_RENDER_IMPROVED
 		xPos = DynamicLights[i].x - room->x;
 		yPos = DynamicLights[i].y;
 		zPos = DynamicLights[i].z - room->z;
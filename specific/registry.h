@@ -91,6 +91,7 @@
 #define REG_JOYSTICK_LED_COLOR	"JoystickLedColor"
 #define REG_JOYSTICK_HINTS		"JoystickHints"
 #define REG_AVOID_INTERLACED	"AvoidInterlacedVideoModes"
+#define REG_GAME_MEMORY_GROWTH	"GameMemoryGrowth"
 #define REG_RUNNING_M16_FIX		"RunningM16fix"
 #define REG_LOWCEILING_JUMP_FIX	"LowCeilingJumpFix"
 
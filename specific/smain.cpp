@@ -46,6 +46,10 @@
 #include "modding/background_new.h"
 #include "global/vars.h"
 
+#ifdef FEATURE_BENCHMARK
+#include "modding/benchmark.h"
+#endif // FEATURE_BENCHMARK
+
 #ifdef FEATURE_HUD_IMPROVED
 extern DWORD DemoTextMode;
 extern DWORD JoystickButtonStyle;
@@ -258,6 +262,12 @@ BOOL __cdecl GameMain() {
 
 			case GF_EXIT_TO_TITLE :
 			case GF_EXIT_TO_OPTION :
+#ifdef FEATURE_BENCHMARK
+				if( BenchmarkEnabled ) {
+					gfOption = BENCH_NextDemo();
+					break;
+				}
+#endif // FEATURE_BENCHMARK
 				if( (GF_GameFlow.flags & GFF_TitleDisabled) != 0 ) {
 					gfOption = GF_GameFlow.titleReplace;
 					if( gfOption == GF_EXIT_TO_TITLE || gfOption < 0 ) {
@@ -43,10 +43,47 @@
 #include "modding/gdi_utils.h"
 #endif // defined(FEATURE_SCREENSHOT_IMPROVED) || defined(FEATURE_BACKGROUND_IMPROVED)
 
+#ifdef FEATURE_EXTENDED_LIMITS
+#include "3dsystem/3d_arena.h"
+#endif // FEATURE_EXTENDED_LIMITS
+
+#ifdef FEATURE_SIMD_RENDER
+#include "3dsystem/3d_simd.h"
+#endif // FEATURE_SIMD_RENDER
+
+#ifdef FEATURE_BENCHMARK
+#include "modding/benchmark.h"
+#include "modding/hwr_record.h"
+#endif // FEATURE_BENCHMARK
+
+#ifdef FEATURE_LOADING_IMPROVED
+#include "modding/task_pool.h"
+#endif // FEATURE_LOADING_IMPROVED
+
+#ifdef FEATURE_ENGINE_IMPROVED
+#include "modding/box_zones.h"
+#include "modding/floor_cache.h"
+#include "modding/room_grid.h"
+#include "modding/static_index.h"
+#endif // FEATURE_ENGINE_IMPROVED
+
+#ifdef FEATURE_RENDER_IMPROVED
+#include "3dsystem/3d_cull.h"
+#include "3dsystem/3d_tiles.h"
+#include "modding/light_cluster.h"
+#include "modding/light_probe.h"
+#include "modding/room_pvs.h"
+#include "modding/vertex_grid.h"
+#endif // FEATURE_RENDER_IMPROVED
+
 #ifdef FEATURE_NOLEGACY_OPTIONS
 extern bool AvoidInterlacedVideoModes;
 #endif // FEATURE_NOLEGACY_OPTIONS
 
+#ifdef FEATURE_EXTENDED_LIMITS
+extern bool GameMemoryGrowth;
+#endif // FEATURE_EXTENDED_LIMITS
+
 #if defined(_MSC_VER)
 #include <se.h>
 
@@ -162,6 +199,13 @@ int __cdecl Init(bool skipCDInit) {
 		return 2;
 
 	UT_InitAccurateTimer();
+#ifdef FEATURE_SIMD_RENDER
+	SIMD_Init();
+#endif // FEATURE_SIMD_RENDER
+#ifdef FEATURE_BENCHMARK
+	BENCH_Init();
+	HREC_Init();
+#endif // FEATURE_BENCHMARK
 
 #ifdef FEATURE_NOLEGACY_OPTIONS
 	if( OpenGameRegistryKey(REG_SYSTEM_KEY) ) {
@@ -169,11 +213,20 @@ int __cdecl Init(bool skipCDInit) {
 		CloseGameRegistryKey();
 	}
 #endif // FEATURE_NOLEGACY_OPTIONS
+#ifdef FEATURE_EXTENDED_LIMITS
+	if( OpenGameRegistryKey(REG_SYSTEM_KEY) ) {
+		GetRegistryBoolValue(REG_GAME_MEMORY_GROWTH, &GameMemoryGrowth, false);
+		CloseGameRegistryKey();
+	}
+#endif // FEATURE_EXTENDED_LIMITS
 
 	if(
 #if defined(FEATURE_SCREENSHOT_IMPROVED) || defined(FEATURE_BACKGROUND_IMPROVED)
 		GDI_Init() &&
 #endif // defined(FEATURE_SCREENSHOT_IMPROVED) || defined(FEATURE_BACKGROUND_IMPROVED)
+#ifdef FEATURE_EXTENDED_LIMITS
+		ARENA_Init() &&
+#endif // FEATURE_EXTENDED_LIMITS
 		WinVidInit() &&
 		Direct3DInit() &&
 		RenderInit() &&
@@ -197,6 +250,30 @@ void __cdecl WinCleanup() {
 #if defined(FEATURE_SCREENSHOT_IMPROVED) || defined(FEATURE_BACKGROUND_IMPROVED)
 	GDI_Cleanup();
 #endif // defined(FEATURE_SCREENSHOT_IMPROVED) || defined(FEATURE_BACKGROUND_IMPROVED)
+#ifdef FEATURE_LOADING_IMPROVED
+	TASK_Cleanup();
+#endif // FEATURE_LOADING_IMPROVED
+#ifdef FEATURE_RENDER_IMPROVED
+	SWR_Cleanup();
+	CULL_Cleanup();
+	PVS_Cleanup();
+	LPROBE_Cleanup();
+	VGRID_Cleanup();
+	LCLUST_Cleanup();
+#endif // FEATURE_RENDER_IMPROVED
+#ifdef FEATURE_ENGINE_IMPROVED
+	SIDX_Cleanup();
+	RGRID_Cleanup();
+	FCACHE_Cleanup();
+	BZONE_Cleanup();
+#endif // FEATURE_ENGINE_IMPROVED
+#ifdef FEATURE_BENCHMARK
+	BENCH_Cleanup();
+	HREC_Cleanup();
+#endif // FEATURE_BENCHMARK
+#ifdef FEATURE_EXTENDED_LIMITS
+	ARENA_Cleanup();
+#endif // FEATURE_EXTENDED_LIMITS
 }
 
 int __cdecl WinGameStart() {